@@ -0,0 +1,48 @@
+#include "ADC.h"
+
+
+Saadc_job saadc_job = {true, NULL, NULL};
+
+
+
+/*
+ * SAADC interrupt handler. Drives the conversion START -> SAMPLE -> END -> STOP sequence (or CALIBRATEOFFSET -> STOP), so that CPU can sleep 
+ * instead of polling events. Every event is cleared and read back, otherwise the interrupt could fire again on exit.
+ */
+extern "C" void SAADC_IRQHandler(void)
+{
+    if (saadc_job.irq_owner != NULL)
+    {
+        saadc_job.irq_owner();
+        return;
+    }
+    if (NRF_SAADC->EVENTS_STARTED)
+    {
+        NRF_SAADC->EVENTS_STARTED = 0x00UL;
+        (void)NRF_SAADC->EVENTS_STARTED;
+        NRF_SAADC->TASKS_SAMPLE = 0x01UL;     // EasyDMA pointer is latched, so the conversion can be triggered
+    }
+    if (NRF_SAADC->EVENTS_END)
+    {
+        NRF_SAADC->EVENTS_END = 0x00UL;
+        (void)NRF_SAADC->EVENTS_END;
+        NRF_SAADC->TASKS_STOP = 0x01UL;
+    }
+    if (NRF_SAADC->EVENTS_CALIBRATEDONE)
+    {
+        NRF_SAADC->EVENTS_CALIBRATEDONE = 0x00UL;
+        (void)NRF_SAADC->EVENTS_CALIBRATEDONE;
+        NRF_SAADC->TASKS_STOP = 0x01UL;
+    }
+    if (NRF_SAADC->EVENTS_STOPPED)
+    {
+        NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+        (void)NRF_SAADC->EVENTS_STOPPED;
+        NRF_SAADC->INTENCLR = SAADC_INTENCLR_STARTED_Msk | SAADC_INTENCLR_END_Msk | SAADC_INTENCLR_CALIBRATEDONE_Msk | SAADC_INTENCLR_STOPPED_Msk;
+        saadc_job.done = true;
+        if (saadc_job.done_handler != NULL)
+        {
+            saadc_job.done_handler();
+        }
+    }
+}
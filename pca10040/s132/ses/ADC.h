@@ -6,6 +6,8 @@
 extern "C" {
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
+#include "app_util_platform.h"
+#include "nrf_pwr_mgmt.h"
 
 #ifdef ADC_DEBUG    
 #include "math.h"
@@ -13,72 +15,184 @@ extern "C" {
 }
 
 #include "sd_func_wrapper.h"
+#include "my_utility.h"
+
+
+// Handler called (in interrupt context) when an asynchronous conversion is finished. Keep it short, for example just set a flag.
+typedef void (*adc_done_handler_t)(void);
+
+
+/*
+ * State of the currently running SAADC job. It is shared with SAADC_IRQHandler(), that's why it can't be a member of ADC.
+ * done - true when there's no conversion running (result can be collected)
+ * done_handler - optional handler, called from the interrupt when the conversion is finished
+ */
+struct Saadc_job
+{
+    volatile bool done;
+    adc_done_handler_t done_handler;
+    adc_done_handler_t irq_owner;     // if set, SAADC_IRQHandler() forwards all events to it (Sampling_engine owns SAADC while running)
+};
+
+extern Saadc_job saadc_job;     // defined in ADC.cpp, together with SAADC_IRQHandler()
+
+extern "C" void SAADC_IRQHandler(void);
+
 
 
 /*
  * Class representing adc job in my project. In my project adc is used to read pressure and Vbat
+ *
+ * Template parameter combined_scan selects how analogReadPressureAndVbat() works. If false, pressure and Vbat are read 
+ * in two separate conversion sessions. If true, CH[0] (bridge) and CH[1] (VDD) are set up once and captured in one 
+ * START/SAMPLE/END session, using EasyDMA scan mode.
+ *
+ * analogReadPressureBurst() captures a short burst of samples in one bridge-on window and reduces it with a trimmed mean,
+ * instead of relying on 32x oversampling (which averages radio spikes in).
+ *
+ * Conversions are interrupt driven. analogReadPressure() and analogReadVbat() sleep (nrf_pwr_mgmt_run()) until 
+ * the conversion is done. If you don't want to wait at all, call startPressureConversion() / startVbatConversion(), 
+ * wait for the handler or isConversionDone() and collect the result with finishPressureConversion() / finishVbatConversion().
  */
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan = false>
 class ADC
 {
+    static const uint8_t SCAN_CHANNELS = 2;     // CH[0] + CH[1], captured by analogReadPressureAndVbat() in combined scan mode
+
+  public:
+    // analogReadPressureBurst() captures 2^burst_log2 samples, a quarter of them lowest and a quarter highest are dropped.
+    static const uint8_t BURST_LOG2_MIN = 2;     // 4 samples, 1 dropped from each end
+    static const uint8_t BURST_LOG2_MAX = 5;     // 32 samples
+
+  private:
+    static const uint8_t BURST_MAX_COUNT = 1 << BURST_LOG2_MAX;
+    static const uint16_t BURST_SAMPLERATE_CC = 96;     // 16MHz / 96 = 167kHz, leaves margin above TACQ 3us + 2us conversion
+
+    volatile int16_t result;		// EasyDMA writes conversion result here. ADC outputs 16 bit signed result
+    volatile int16_t scan_result[SCAN_CHANNELS];     // EasyDMA writes the scan here (pressure, Vbat)
+    volatile int16_t burst_result[BURST_MAX_COUNT];     // EasyDMA writes burst samples here
+
+    uint8_t pressure_oversample = SAADC_OVERSAMPLE_OVERSAMPLE_Over32x;     // found empirically to be the most optimal, can be changed at runtime
+    uint8_t burst_log2 = 4;     // 16 samples by default, can be changed at runtime
 
     void enable();
     void disable();
-	void setupForPressure();
 	void setupForVbat();
+	void setupForScan();
+	void setupForBurst();
+	void startConversion(volatile int16_t *p_buffer, uint16_t p_count, adc_done_handler_t p_done_handler);
+	void waitForConversion();
 
   public:
+	void setupForPressure();	 // public, because Sampling_engine sets SAADC up the same way
     void calibrate();	 // call during startup, or every time temperature changes significantly
+	void startCalibration(adc_done_handler_t p_done_handler = NULL);
+	void finishCalibration();
+	int16_t measureOffset();
 	ADC();		// call once during startup, sets the ADC up.
     uint16_t analogReadPressure();		// call every time you want to read
 	uint16_t analogReadVbat();
+	void analogReadPressureAndVbat(uint16_t &p_pressure_raw, uint16_t &p_vbat_raw);
+	uint16_t analogReadPressureBurst();
+
+	void startPressureConversion(adc_done_handler_t p_done_handler = NULL);
+	void startVbatConversion(adc_done_handler_t p_done_handler = NULL);
+	bool isConversionDone();
+	uint16_t finishPressureConversion();
+	uint16_t finishVbatConversion();
+
+	void setPressureOversample(uint8_t p_oversample);
+	uint8_t getPressureOversample();
+	void setPressureBurst(uint8_t p_burst_log2);
+	uint8_t getPressureBurst();
 };
 
 // enables the ADC for a conversion
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::enable()
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::enable()
 {
     NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos);
 }
 
 
 // disables the ADC after a conversion
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::disable()
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::disable()
 {
     NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos);
 }
 
 
-// Recalibrates adc. Call during startup, or every time temperature changes 10*C
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::calibrate()
+// Recalibrates adc. Call during startup, or every time temperature changes 10*C. CPU sleeps while calibration runs.
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::calibrate()
+{
+    startCalibration();
+    waitForConversion();
+    finishCalibration();
+}
+
+
+
+/*
+ * Starts offset calibration and returns immediately. Call finishCalibration(), once p_done_handler is called or 
+ * isConversionDone() returns true. SAADC can't be used for readings in the meantime.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::startCalibration(adc_done_handler_t p_done_handler)
 {
     enable();
 
-    NRF_SAADC->TASKS_STOP = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STOPPED);
+    saadc_job.done_handler = p_done_handler;
+    saadc_job.done = false;
+
+    NRF_SAADC->EVENTS_CALIBRATEDONE = 0x00UL;
     NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    NRF_SAADC->INTENSET = SAADC_INTENSET_CALIBRATEDONE_Msk | SAADC_INTENSET_STOPPED_Msk;     // SAADC_IRQHandler() stops SAADC after calibration
 
     NRF_SAADC->TASKS_CALIBRATEOFFSET = 0x01UL;
-    while (!NRF_SAADC->EVENTS_CALIBRATEDONE);
-    NRF_SAADC->EVENTS_CALIBRATEDONE = 0x00UL;
+}
 
-    NRF_SAADC->TASKS_STOP = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STOPPED);
 
-    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
 
+// Finishes calibration started with startCalibration().
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::finishCalibration()
+{
     disable();
 }
 
 
-// Constructor. Configures bridge Vcc pin.
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-ADC<_bridge_pin, positive_in_pin, negative_in_pin>::ADC()
+
+/*
+ * Measures current SAADC offset: pressure channel is read with both inputs connected to the negative input pin, 
+ * so ideally the result is 0. Call just before calibration to see how much the offset drifted since the last one.
+ * CPU sleeps while the conversion runs.
+ * Returns: offset in raw SAADC units (before removing the noisy LSB)
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+int16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::measureOffset()
+{
+    setupForPressure();
+    NRF_SAADC->CH[0].PSELP = negative_in_pin;     // short the differential input
+    startConversion(&result, 1, NULL);
+    waitForConversion();
+    disable();
+    return result;
+}
+
+
+// Constructor. Configures bridge Vcc pin and SAADC interrupt.
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::ADC()
 {
    // configures bridge supply pin as output high drive.
    nrf_gpio_cfg(_bridge_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_DISCONNECT, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_S0H1, NRF_GPIO_PIN_NOSENSE);
+
+   NRF_SAADC->INTENCLR = 0xFFFFFFFFUL;     // events are enabled per conversion, in startConversion()
+   NVIC_SetPriority(SAADC_IRQn, APP_IRQ_PRIORITY_LOW);
+   NVIC_ClearPendingIRQ(SAADC_IRQn);
+   NVIC_EnableIRQ(SAADC_IRQn);
 }
 
 
@@ -86,11 +200,12 @@ ADC<_bridge_pin, positive_in_pin, negative_in_pin>::ADC()
 /*
  * Private method for setting adc channel for reading pressure sensor bridge.
  */
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::setupForPressure()
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setupForPressure()
 {
     NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;		// found empirically to be the most optimal. Doesn't include useless noise. 
-    NRF_SAADC->OVERSAMPLE = (SAADC_OVERSAMPLE_OVERSAMPLE_Over32x << SAADC_OVERSAMPLE_OVERSAMPLE_Pos) & SAADC_OVERSAMPLE_OVERSAMPLE_Msk;     // found empirically to be the most optimal
+    NRF_SAADC->OVERSAMPLE = (pressure_oversample << SAADC_OVERSAMPLE_OVERSAMPLE_Pos) & SAADC_OVERSAMPLE_OVERSAMPLE_Msk;     // 32x by default, see setPressureOversample()
+    NRF_SAADC->SAMPLERATE = (SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos) & SAADC_SAMPLERATE_MODE_Msk;     // one sample per SAMPLE task
 
     for (int i = 0; i < 8; i++)		// disable unused channels (so that ADC doesn't enter scan mode)
     {
@@ -98,7 +213,7 @@ void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::setupForPressure()
         NRF_SAADC->CH[i].PSELP = SAADC_CH_PSELP_PSELP_NC;
     }
 	
-	// Channel configuration. Oversampling is on (x32) (higher settings don't seem to decrease noise, while they make conversion take longer.
+	// Channel configuration. Oversampling is on (x32 by default) (higher settings don't seem to decrease noise, while they make conversion take longer.
 	// Refence is VDD, because sensor is powered by VDD (via GPIO). 
 	// Gain 4, sets input limit +-VDD/16. For example if VDD = 3.0V, ADC can measure +-0.188V (enough for MD-PS002)
 	// Gain 1, sets input limit to +-VDD/4. For example if VDD = 3.0V, ADC can measure +-0.75V (enough for MS5407)
@@ -120,11 +235,12 @@ void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::setupForPressure()
 /*
  * Private method for setting adc channel for reading Vbat.
  */
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::setupForVbat()
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setupForVbat()
 {
     NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_8bit;		// found empirically to be the most optimal 
     NRF_SAADC->OVERSAMPLE = (SAADC_OVERSAMPLE_OVERSAMPLE_Over8x << SAADC_OVERSAMPLE_OVERSAMPLE_Pos) & SAADC_OVERSAMPLE_OVERSAMPLE_Msk;    // oversampling x8 found to be enough.
+    NRF_SAADC->SAMPLERATE = (SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos) & SAADC_SAMPLERATE_MODE_Msk;
 
     for (int i = 0; i < 8; i++)		// disable unused channels (so that ADC doesn't enter scan mode)
     {
@@ -151,40 +267,156 @@ void ADC<_bridge_pin, positive_in_pin, negative_in_pin>::setupForVbat()
 
 
 
-// Call every time you want to read pressure.
-// Returns pressure raw reading. To convert it into Bar, you have map sensor reading, using some coefficients calculated by excel's linear regression
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin>::analogReadPressure()
+/*
+ * Private method for setting adc up for combined scan: CH[0] reads pressure sensor bridge, CH[1] reads Vbat.
+ * Both channels are set up once and captured in the same session, so RESOLUTION and OVERSAMPLE are shared.
+ * Both channels have BURST enabled: one SAMPLE task then takes all oversamples of CH[0] back to back and averages them,
+ * then does the same for CH[1]. Without burst, oversampling would average across the channels.
+ * So the whole scan is one SAMPLE and one END, CPU doesn't wake up between oversamples.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setupForScan()
 {
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;		// pressure needs 12 bit, Vbat gets scaled down to 8 bit
+    NRF_SAADC->OVERSAMPLE = (pressure_oversample << SAADC_OVERSAMPLE_OVERSAMPLE_Pos) & SAADC_OVERSAMPLE_OVERSAMPLE_Msk;     // the same as analogReadPressure(), Vbat gets it too
+    NRF_SAADC->SAMPLERATE = (SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos) & SAADC_SAMPLERATE_MODE_Msk;     // one scan per SAMPLE task
+
+    for (int i = SCAN_CHANNELS; i < 8; i++)		// disable unused channels (only CH[0] and CH[1] are scanned)
+    {
+        NRF_SAADC->CH[i].PSELN = SAADC_CH_PSELP_PSELP_NC;
+        NRF_SAADC->CH[i].PSELP = SAADC_CH_PSELP_PSELP_NC;
+    }
+
+	// CH[0] - same as setupForPressure()
+	NRF_SAADC->CH[0].CONFIG =   ((SAADC_CH_CONFIG_RESP_Bypass   << SAADC_CH_CONFIG_RESP_Pos)   & SAADC_CH_CONFIG_RESP_Msk)
+							 | ((SAADC_CH_CONFIG_RESP_Bypass    << SAADC_CH_CONFIG_RESN_Pos)   & SAADC_CH_CONFIG_RESN_Msk)
+							 | ((SAADC_CH_CONFIG_GAIN_Gain1     << SAADC_CH_CONFIG_GAIN_Pos)   & SAADC_CH_CONFIG_GAIN_Msk)
+							 | ((SAADC_CH_CONFIG_REFSEL_VDD1_4  << SAADC_CH_CONFIG_REFSEL_Pos) & SAADC_CH_CONFIG_REFSEL_Msk)
+							 | ((SAADC_CH_CONFIG_TACQ_3us       << SAADC_CH_CONFIG_TACQ_Pos)   & SAADC_CH_CONFIG_TACQ_Msk)
+							 | ((SAADC_CH_CONFIG_BURST_Enabled  << SAADC_CH_CONFIG_BURST_Pos)  & SAADC_CH_CONFIG_BURST_Msk)
+							 | ((SAADC_CH_CONFIG_MODE_Diff      << SAADC_CH_CONFIG_MODE_Pos)   & SAADC_CH_CONFIG_MODE_Msk);
+    NRF_SAADC->CH[0].PSELN = negative_in_pin;     // differential mode
+    NRF_SAADC->CH[0].PSELP = positive_in_pin;
+
+	// CH[1] - same as setupForVbat()
+	NRF_SAADC->CH[1].CONFIG =   ((SAADC_CH_CONFIG_RESP_Bypass   << SAADC_CH_CONFIG_RESP_Pos)   & SAADC_CH_CONFIG_RESP_Msk)
+							 | ((SAADC_CH_CONFIG_RESP_Bypass    << SAADC_CH_CONFIG_RESN_Pos)   & SAADC_CH_CONFIG_RESN_Msk)
+							 | ((SAADC_CH_CONFIG_GAIN_Gain1_6   << SAADC_CH_CONFIG_GAIN_Pos)   & SAADC_CH_CONFIG_GAIN_Msk)
+							 | ((SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) & SAADC_CH_CONFIG_REFSEL_Msk)
+							 | ((SAADC_CH_CONFIG_TACQ_3us       << SAADC_CH_CONFIG_TACQ_Pos)   & SAADC_CH_CONFIG_TACQ_Msk)
+							 | ((SAADC_CH_CONFIG_BURST_Enabled  << SAADC_CH_CONFIG_BURST_Pos)  & SAADC_CH_CONFIG_BURST_Msk)
+							 | ((SAADC_CH_CONFIG_MODE_SE        << SAADC_CH_CONFIG_MODE_Pos)   & SAADC_CH_CONFIG_MODE_Msk);
+    NRF_SAADC->CH[1].PSELN = SAADC_CH_PSELP_PSELP_NC;
+    NRF_SAADC->CH[1].PSELP = SAADC_CH_PSELP_PSELP_VDD;       // single ended mode
+}
+
+
+
+
+/*
+ * Private method for setting adc up for a burst of pressure samples. Channel is set up by setupForPressure(), then 
+ * oversampling is bypassed and SAADC internal timer triggers samples back to back, until the buffer is full.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setupForBurst()
+{
+    setupForPressure();
+    NRF_SAADC->OVERSAMPLE = (SAADC_OVERSAMPLE_OVERSAMPLE_Bypass << SAADC_OVERSAMPLE_OVERSAMPLE_Pos) & SAADC_OVERSAMPLE_OVERSAMPLE_Msk;
+    NRF_SAADC->CH[0].CONFIG &= ~SAADC_CH_CONFIG_BURST_Msk;     // burst only makes sense with oversampling
+    NRF_SAADC->SAMPLERATE = ((SAADC_SAMPLERATE_MODE_Timers << SAADC_SAMPLERATE_MODE_Pos) & SAADC_SAMPLERATE_MODE_Msk)
+                          | ((BURST_SAMPLERATE_CC << SAADC_SAMPLERATE_CC_Pos) & SAADC_SAMPLERATE_CC_Msk);
+}
+
+
+
+
+/*
+ * Private method for starting an already set up conversion. Returns immediately, SAADC_IRQHandler() takes it from here.
+ * Params: p_buffer - buffer for EasyDMA
+ *         p_count - number of samples to be written to p_buffer (before END)
+ *         p_done_handler - handler called from the interrupt when the conversion is done (can be NULL)
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::startConversion(volatile int16_t *p_buffer, uint16_t p_count, adc_done_handler_t p_done_handler)
+{
+    enable();
+
+    NRF_SAADC->RESULT.PTR = (uint32_t)(uintptr_t)p_buffer;	 // pointer to 16 bit ints with result, that is stored in 32bit register
+    NRF_SAADC->RESULT.MAXCNT = p_count;
+
+    saadc_job.done_handler = p_done_handler;
+    saadc_job.done = false;
+
+    NRF_SAADC->EVENTS_STARTED = 0x00UL;
+    NRF_SAADC->EVENTS_END = 0x00UL;
+    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk | SAADC_INTENSET_STOPPED_Msk;
+
+    NRF_SAADC->TASKS_START = 0x01UL;
+}
+
+
+
+/*
+ * Private method that sleeps in system on mode until the running conversion is done.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::waitForConversion()
+{
+    while (!saadc_job.done)
+    {
+        nrf_pwr_mgmt_run();		// in case any other event woke MCU, go to sleep again
+    }
+}
+
 
-    disableDC2DC();    // I found disabling DCDC during the reading minimized noise a bit.
 
+/*
+ * Returns true if there's no conversion running, so the result can be collected.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+bool ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::isConversionDone()
+{
+    return saadc_job.done;
+}
+
+
+
+/*
+ * Starts pressure conversion and returns immediately. Collect the result with finishPressureConversion(), 
+ * once p_done_handler is called or isConversionDone() returns true.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::startPressureConversion(adc_done_handler_t p_done_handler)
+{
 	setupForPressure();
 
 	nrf_gpio_pin_set(_bridge_pin);
 
 	//nrf_delay_us(50);		// this delay, could compensate for GPIO rise time, but empirically I didn't found it nessesery
-    enable();
+    disableDC2DC();    // I found disabling DCDC during the reading minimized noise a bit. Off only for the conversion itself
+    startConversion(&result, 1, p_done_handler);     // one sample
+}
 
-    volatile int16_t pressure_raw;		// ADC outputs 16 bit signed result
-    NRF_SAADC->RESULT.PTR = (uint32_t)&pressure_raw;	 // pointer to 16 bit int with result, that is stored in 32bit register
-    NRF_SAADC->RESULT.MAXCNT = 1;		// One sample
 
-    NRF_SAADC->TASKS_START = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STARTED);
-    NRF_SAADC->EVENTS_STARTED = 0x00UL;
 
-    NRF_SAADC->TASKS_SAMPLE = 0x01UL;
-    while (!NRF_SAADC->EVENTS_END);
-    NRF_SAADC->EVENTS_END = 0x00UL;
+/*
+ * Finishes pressure conversion started with startPressureConversion(). Call from main context (not from the handler), 
+ * when the conversion is done. Powers the bridge down and restores DCDC.
+ * Returns pressure raw reading.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::finishPressureConversion()
+{
+	enableDC2DC();     // first thing, the conversion is over
 
-    NRF_SAADC->TASKS_STOP = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STOPPED);
-    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+#ifndef ADC_DEBUG      // if ADC_DEBUG is defined, pressure sensor is powered all the time. Useful for checking its output with multimeter
+	nrf_gpio_pin_clear(_bridge_pin);		// turn off the sensor bridge
+#endif //ADC_DEBUG
 
-	enableDC2DC();
+    disable();
 
-	pressure_raw = pressure_raw >> 1;	// just to remove useless noisy LSB
+	int16_t pressure_raw = result >> 1;	// just to remove useless noisy LSB
 
 #ifdef ADC_DEBUG
 	printf("%d\n", pressure_raw);
@@ -194,50 +426,176 @@ uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin>::analogReadPressure(
         pressure_raw = 0;
 #endif //ADC_DEBUG
 
-    disable();
-
-#ifndef ADC_DEBUG      // if ADC_DEBUG is defined, pressure sensor is powered all the time. Useful for checking its output with multimeter
-	nrf_gpio_pin_clear(_bridge_pin);		// turn off the sensor bridge
-#endif //ADC_DEBUG
-
     return (uint16_t)pressure_raw;
 }
 
 
-// vvv edit comment
-// call every time you want to read.
-// Returns pressure raw reading. To convert it into Bar, you have map sensor reading, using for example excel linear regression
-template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin>
-uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin>::analogReadVbat()
+
+/*
+ * Starts Vbat conversion and returns immediately. Collect the result with finishVbatConversion(), 
+ * once p_done_handler is called or isConversionDone() returns true.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::startVbatConversion(adc_done_handler_t p_done_handler)
 {
 	setupForVbat();
-    enable();
+    startConversion(&result, 1, p_done_handler);     // one sample
+}
 
-    volatile int16_t pressure_raw;		// ADC outputs 16 bit signed result
-    NRF_SAADC->RESULT.PTR = (uint32_t)&pressure_raw;	 // pointer to 16 bit int with result, that is stored in 32bit register
-    NRF_SAADC->RESULT.MAXCNT = 1;		// One sample
 
-    NRF_SAADC->TASKS_START = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STARTED);
-    NRF_SAADC->EVENTS_STARTED = 0x00UL;
 
-    NRF_SAADC->TASKS_SAMPLE = 0x01UL;
-    while (!NRF_SAADC->EVENTS_END);
-    NRF_SAADC->EVENTS_END = 0x00UL;
+/*
+ * Finishes Vbat conversion started with startVbatConversion(). Call when the conversion is done.
+ * Returns Vbat raw reading (8 bit).
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::finishVbatConversion()
+{
+    disable();
 
-    NRF_SAADC->TASKS_STOP = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STOPPED);
-    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    int16_t vbat_raw = result;
+    if (vbat_raw < 0)	// not super - neccesery (Vbat reading shouldn't be negative on it's own)
+    {
+        vbat_raw = 0;
+    }
+    return (uint16_t)vbat_raw;
+}
 
-	//pressure_raw = pressure_raw >> 1;	// just to remove useless noisy LSB
-    if (pressure_raw < 0)	// not super - neccesery (pressure reading shouldn't be negative on it's own)
+
+
+// Call every time you want to read pressure. CPU sleeps while the conversion runs.
+// Returns pressure raw reading. To convert it into Bar, you have map sensor reading, using some coefficients calculated by excel's linear regression
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::analogReadPressure()
+{
+    startPressureConversion();
+    waitForConversion();
+    return finishPressureConversion();
+}
+
+
+// Call every time you want to read Vbat. CPU sleeps while the conversion runs.
+// Returns Vbat raw reading (8 bit). To convert it into %s use mapVbat().
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::analogReadVbat()
+{
+    startVbatConversion();
+    waitForConversion();
+    return finishVbatConversion();
+}
+
+
+/*
+ * Call every time you want to read both pressure and Vbat. CPU sleeps while the conversion runs.
+ * With combined_scan it costs one conversion session instead of two.
+ * Params: p_pressure_raw - returns pressure raw reading (same scale as analogReadPressure())
+ *         p_vbat_raw - returns Vbat raw reading (same 8 bit scale as analogReadVbat())
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::analogReadPressureAndVbat(uint16_t &p_pressure_raw, uint16_t &p_vbat_raw)
+{
+    if (!combined_scan)
     {
-        pressure_raw = 0;
+        p_vbat_raw = analogReadVbat();
+        p_pressure_raw = analogReadPressure();
+        return;
     }
 
+	setupForScan();
+	nrf_gpio_pin_set(_bridge_pin);
+
+    disableDC2DC();    // I found disabling DCDC during the reading minimized noise a bit.
+    startConversion(scan_result, SCAN_CHANNELS, NULL);		// one scan, both channels oversampled by hardware
+    waitForConversion();
+	enableDC2DC();
+
+#ifndef ADC_DEBUG
+	nrf_gpio_pin_clear(_bridge_pin);		// turn off the sensor bridge
+#endif //ADC_DEBUG
     disable();
 
-    return (uint16_t)pressure_raw;
+    int32_t pressure_raw = scan_result[0] >> 1;	 // remove useless noisy LSB, like analogReadPressure()
+    int32_t vbat_raw = scan_result[1] >> 4;	 // 12 bit -> 8 bit, so that mapVbat() works unchanged
+    p_pressure_raw = (pressure_raw < 0) ? 0 : (uint16_t)pressure_raw;
+    p_vbat_raw = (vbat_raw < 0) ? 0 : (uint16_t)vbat_raw;
+}
+
+
+/*
+ * Call every time you want to read pressure in burst mode. CPU sleeps while the conversion runs.
+ * 2^burst_log2 samples (16 by default, see setPressureBurst()) are taken in one bridge-on window (shorter than 32x 
+ * oversampling) and reduced with a trimmed mean.
+ * Returns pressure raw reading, in the same units analogReadPressure() returns.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint16_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::analogReadPressureBurst()
+{
+	setupForBurst();
+	nrf_gpio_pin_set(_bridge_pin);
+    disableDC2DC();    // I found disabling DCDC during the reading minimized noise a bit.
+    const uint8_t count = 1 << burst_log2;
+    startConversion(burst_result, count, NULL);
+    waitForConversion();
+	enableDC2DC();
+
+#ifndef ADC_DEBUG
+	nrf_gpio_pin_clear(_bridge_pin);		// turn off the sensor bridge
+#endif //ADC_DEBUG
+    disable();
+
+    int16_t samples[BURST_MAX_COUNT];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        samples[i] = burst_result[i];
+    }
+    int32_t pressure_raw = trimmedMean(samples, count, count / 4) >> 1;	 // remove useless noisy LSB, like analogReadPressure()
+    return (pressure_raw < 0) ? 0 : (uint16_t)pressure_raw;
+}
+
+
+
+/*
+ * Sets oversampling used for pressure readings (analogReadPressure(), Sampling_engine). 
+ * Params: p_oversample - SAADC OVERSAMPLE register value (log2 of averaged samples), for example SAADC_OVERSAMPLE_OVERSAMPLE_Over32x
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setPressureOversample(uint8_t p_oversample)
+{
+    pressure_oversample = p_oversample;
+}
+
+
+
+/*
+ * Returns oversampling used for pressure readings (SAADC OVERSAMPLE register value). Useful for diagnostics.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint8_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::getPressureOversample()
+{
+    return pressure_oversample;
+}
+
+
+/*
+ * Sets burst length used by analogReadPressureBurst(). Like oversampling, noise variance scales with 1 / 2^p_burst_log2 
+ * and bridge on time with 2^p_burst_log2.
+ * Params: p_burst_log2 - log2 of the number of samples, BURST_LOG2_MIN to BURST_LOG2_MAX
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+void ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::setPressureBurst(uint8_t p_burst_log2)
+{
+    burst_log2 = constrain(p_burst_log2, BURST_LOG2_MIN, BURST_LOG2_MAX);
+}
+
+
+
+/*
+ * Returns burst length used by analogReadPressureBurst() (log2 of the number of samples). Useful for diagnostics.
+ */
+template <uint32_t _bridge_pin, uint32_t positive_in_pin, uint32_t negative_in_pin, bool combined_scan>
+uint8_t ADC<_bridge_pin, positive_in_pin, negative_in_pin, combined_scan>::getPressureBurst()
+{
+    return burst_log2;
 }
 
 
@@ -0,0 +1,196 @@
+#ifndef AD_FRAME_H
+#define AD_FRAME_H
+
+#include <stdint.h>
+
+
+/*
+ * Compile time advertising frame composer. A frame is declared as a list of AD structures, each made of constant bytes
+ * and typed slots. The byte array, its length and slot offsets are all generated at compile time, so writing a slot
+ * is a plain store at a constant offset, and a layout change can't make setters write to the wrong bytes.
+ *
+ * Example:
+ *   struct Pressure_field { typedef uint16_t type; };     // slot tag, type defines slot size
+ *   typedef Ad_frame<
+ *       Ad_structure<BLE_GAP_AD_TYPE_FLAGS, Ad_bytes<BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE>>,
+ *       Ad_structure<BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, Ad_bytes<0x00, 0x01>, Ad_slot<Pressure_field>>
+ *   > Frame;
+ *   Frame::data() - initial frame bytes, Frame::SIZE - frame length
+ *   Frame::set<Pressure_field>(buffer, 250);     // little endian store at Frame::offset<Pressure_field>()
+ */
+
+
+
+// Constant bytes. Also used as the byte list, that every other part generates.
+template <uint8_t... BYTES>
+struct Ad_bytes
+{
+    typedef Ad_bytes<BYTES...> bytes;
+    static const uint8_t SIZE = sizeof...(BYTES);
+    static const uint8_t data[sizeof...(BYTES) + 1];     // +1, so that an empty list is still a valid array
+
+    template <class TAG>
+    struct find
+    {
+        static const bool found = false;
+        static const uint8_t offset = 0;
+    };
+};
+
+template <uint8_t... BYTES>
+const uint8_t Ad_bytes<BYTES...>::data[sizeof...(BYTES) + 1] = {BYTES..., 0};
+
+
+
+// Concatenates byte lists.
+template <class... PARTS>
+struct Ad_concat
+{
+    typedef Ad_bytes<> type;
+};
+
+template <uint8_t... A>
+struct Ad_concat<Ad_bytes<A...>>
+{
+    typedef Ad_bytes<A...> type;
+};
+
+template <uint8_t... A, uint8_t... B, class... REST>
+struct Ad_concat<Ad_bytes<A...>, Ad_bytes<B...>, REST...>
+{
+    typedef typename Ad_concat<Ad_bytes<A..., B...>, REST...>::type type;
+};
+
+
+
+// N zero bytes.
+template <uint8_t N, uint8_t... BYTES>
+struct Ad_zeros
+{
+    typedef typename Ad_zeros<N - 1, 0, BYTES...>::type type;
+};
+
+template <uint8_t... BYTES>
+struct Ad_zeros<0, BYTES...>
+{
+    typedef Ad_bytes<BYTES...> type;
+};
+
+
+
+// Typed slot, written at runtime. TAG::type defines its size (little endian).
+template <class TAG>
+struct Ad_slot
+{
+    typedef typename Ad_zeros<sizeof(typename TAG::type)>::type bytes;
+};
+
+template <class TAG, class SEARCHED>
+struct Ad_slot_match
+{
+    static const bool value = false;
+};
+
+template <class TAG>
+struct Ad_slot_match<TAG, TAG>
+{
+    static const bool value = true;
+};
+
+
+
+// Offset of slot TAG in a list of parts (counted from the first part).
+template <class TAG, class... PARTS>
+struct Ad_offset
+{
+    static const bool found = false;
+    static const uint8_t value = 0;
+};
+
+template <class TAG, class FIRST, class... REST>
+struct Ad_offset<TAG, FIRST, REST...>
+{
+    static const bool found = FIRST::template find<TAG>::found || Ad_offset<TAG, REST...>::found;
+    static const uint8_t value = FIRST::template find<TAG>::found ? FIRST::template find<TAG>::offset
+                                                                  : FIRST::bytes::SIZE + Ad_offset<TAG, REST...>::value;
+};
+
+template <class TAG, class SLOT_TAG, class... REST>
+struct Ad_offset<TAG, Ad_slot<SLOT_TAG>, REST...>
+{
+    static const bool found = Ad_slot_match<TAG, SLOT_TAG>::value || Ad_offset<TAG, REST...>::found;
+    static const uint8_t value = Ad_slot_match<TAG, SLOT_TAG>::value ? 0
+                                                                     : Ad_slot<SLOT_TAG>::bytes::SIZE + Ad_offset<TAG, REST...>::value;
+};
+
+
+
+// One AD structure: length, AD type, then parts (constant bytes and slots).
+template <uint8_t AD_TYPE, class... PARTS>
+struct Ad_structure
+{
+    typedef typename Ad_concat<Ad_bytes<>, typename PARTS::bytes...>::type payload;
+    static_assert(payload::SIZE < 255, "AD structure too long");
+    typedef typename Ad_concat<Ad_bytes<payload::SIZE + 1, AD_TYPE>, payload>::type bytes;
+
+    template <class TAG>
+    struct find
+    {
+        static const bool found = Ad_offset<TAG, PARTS...>::found;
+        static const uint8_t offset = 2 + Ad_offset<TAG, PARTS...>::value;     // after length and AD type
+    };
+};
+
+
+
+/*
+ * Advertising frame made of AD structures.
+ */
+template <class... STRUCTURES>
+struct Ad_frame
+{
+    typedef typename Ad_concat<Ad_bytes<>, typename STRUCTURES::bytes...>::type bytes;
+    static const uint8_t SIZE = bytes::SIZE;
+
+    // Returns initial frame bytes (slots zeroed).
+    static const uint8_t *data()
+    {
+        return bytes::data;
+    }
+
+    // Returns offset of slot TAG in the frame. Compile time constant.
+    template <class TAG>
+    static constexpr uint8_t offset()
+    {
+        static_assert(Ad_offset<TAG, STRUCTURES...>::found, "slot not declared in this frame");
+        return Ad_offset<TAG, STRUCTURES...>::value;
+    }
+
+    /*
+     * Stores value into slot TAG (little endian).
+     * Params: p_frame - frame buffer (at least SIZE bytes)
+     *         p_value - value to be stored
+     */
+    template <class TAG>
+    static void set(uint8_t *p_frame, typename TAG::type p_value)
+    {
+        for (uint8_t i = 0; i < sizeof(typename TAG::type); i++)     // constant bounds, unrolled by compiler
+        {
+            p_frame[offset<TAG>() + i] = (uint8_t)((uint32_t)p_value >> (8 * i));
+        }
+    }
+
+    // Returns value of slot TAG (little endian).
+    template <class TAG>
+    static typename TAG::type get(const uint8_t *p_frame)
+    {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < sizeof(typename TAG::type); i++)
+        {
+            value |= (uint32_t)p_frame[offset<TAG>() + i] << (8 * i);
+        }
+        return (typename TAG::type)value;
+    }
+};
+
+#endif
@@ -18,6 +18,7 @@ extern "C"
 // Hard reset Vcc fall and rise delay times:
 const static uint32_t DISCHARGE_TIME = 60;
 const static uint32_t VCC_RISE_TIME = 60;
+const static uint32_t SOFT_RESET_TIME = 5;
 
 
 
@@ -129,6 +130,17 @@ class Adxl362
 	uint32_t inactivity_th = 0;
 	uint32_t inactivity_time = 0;
 
+	// startMotionInterrupt() steps, each one ends in setupTimerHandler()
+	enum class Setup_state
+	{
+		IDLE,
+		DISCHARGING,
+		RISING,
+		RESETTING,
+		READY,
+	};
+	volatile Setup_state setup_state = Setup_state::IDLE;
+
 
     const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);		/**< SPI instance. */
 	nrf_drv_spi_config_t m_spi_config;
@@ -141,11 +153,20 @@ class Adxl362
 	void sleepDelay();
 	bool isHung();
 	void setupSensor(uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time);
+	void softReset();
+	void writeSettings(uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time);
+	void startSetupStep(Setup_state p_state, uint32_t p_time_ms);
+	static void setupTimerHandler(void *p_context);
 
 
 public:
 	template <uint32_t p_int_pin, uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time>
 	void setupMotionInterrupt();
+	template <uint32_t p_int_pin, uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time>
+	void resumeMotionInterrupt();
+	template <uint32_t p_int_pin, uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time>
+	void startMotionInterrupt();
+	bool isReady();
 	void superviseAcc();
 
 	
@@ -201,6 +222,7 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupMoti
 	setupSPI();
 	setupSensor(p_act_th, p_inact_th, p_inact_time);
 	uninitSPI();	  // Once the Adxl362 is set MCU can forget about it (I don't sample any acceleration data)
+	setup_state = Setup_state::READY;
 
 #ifdef ADXL362_DEBUG // Print out device_id register. If 0xAD is printed, communication with ADXL_362 is succesful.
 	printf("%d\n", adxlReadRegister(0x00));
@@ -209,6 +231,70 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupMoti
 }
 
 
+/* Public method for taking over adxl362, that was set up by setupMotionInterrupt() before System OFF (warm start).
+ * VCC pin stays high in System OFF, so the sensor kept its settings. They are only checked (one SPI read),
+ * and the sensor is set up again (with VCC discharge), if it lost them. Saves the 120 ms of setupMotionInterrupt().
+ *
+ * The same requirements and params as setupMotionInterrupt().
+ */
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+template <uint32_t p_int_pin, uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::resumeMotionInterrupt()
+{
+	interrupt_pin = p_int_pin;
+	activity_th = p_act_th;
+	inactivity_th = p_inact_th;
+	inactivity_time = p_inact_time;
+
+	nrf_gpio_cfg_sense_input(p_int_pin, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_SENSE_HIGH);
+	initDelay();
+	setup_state = Setup_state::READY;
+	nrf_gpio_pin_set(p_vcc_pin);		// keep VCC high (it already is, if the pin was retained), set before the pin is an output, so it doesn't glitch low
+	nrf_gpio_cfg(p_vcc_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_DISCONNECT, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_H0H1, NRF_GPIO_PIN_NOSENSE);
+	if (adxlReadRegister(THRESH_ACTL) != p_act_th)		// sensor lost its settings (or VCC dropped), full setup in background
+	{
+		startMotionInterrupt<p_int_pin, p_act_th, p_inact_th, p_inact_time>();
+	}
+}
+
+
+/* Public method for setting adxl362 in autonomous motion switch mode without blocking. Does the same as
+ * setupMotionInterrupt(), but every delay (VCC discharge, VCC rise, soft reset) is an app_timer single shot, and the
+ * next step runs in its handler. So the rest of setup (and advertising) goes on during the 125 ms.
+ * isReady() returns true when the sensor is set up. SPI transfers are done in app_timer interrupt, so the sensor
+ * mustn't be used from main() until then.
+ *
+ * The same requirements and params as setupMotionInterrupt().
+ */
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+template <uint32_t p_int_pin, uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::startMotionInterrupt()
+{
+	interrupt_pin = p_int_pin;
+	activity_th = p_act_th;
+	inactivity_th = p_inact_th;
+	inactivity_time = p_inact_time;
+
+	nrf_gpio_cfg_sense_input(p_int_pin, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_SENSE_HIGH);
+	initDelay();
+	nrf_gpio_cfg_input(p_ss_pin, NRF_GPIO_PIN_NOPULL);		// the same as hardResetVcc(), without waiting
+	nrf_gpio_cfg_input(p_miso_pin, NRF_GPIO_PIN_NOPULL);
+	nrf_gpio_cfg_input(p_sck_pin, NRF_GPIO_PIN_NOPULL);
+	nrf_gpio_cfg_input(p_mosi_pin, NRF_GPIO_PIN_NOPULL);
+	nrf_gpio_cfg(p_vcc_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_DISCONNECT, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_H0H1, NRF_GPIO_PIN_NOSENSE);
+	nrf_gpio_pin_clear(p_vcc_pin);		// pull adxl362 VCC to GND
+	startSetupStep(Setup_state::DISCHARGING, DISCHARGE_TIME);
+}
+
+
+// Returns true when the sensor is set up (motion interrupt works and main() can use the sensor).
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+bool Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::isReady()
+{
+	return setup_state == Setup_state::READY;
+}
+
+
 //private method for initializing the SPI driver
 template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
 void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupSPI() {
@@ -266,6 +352,8 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::hardReset
 
 
 APP_TIMER_DEF(adxl362_timer_id);	 // This class uses app timer for delay purposes
+APP_TIMER_DEF(adxl362_setup_timer_id);	 // and for startMotionInterrupt() steps
+static bool adxl362_timers_created = false;
 
 
 /* Timer handler. Used for delay purposes.
@@ -283,8 +371,65 @@ static void VCC_rise_handler(void * p_context)
 template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
 void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::initDelay()
 {
+	if (adxl362_timers_created)		// timers can't be created again, while they may run
+	{
+		return;
+	}
 	uint32_t err_code = app_timer_create(&adxl362_timer_id, APP_TIMER_MODE_SINGLE_SHOT, VCC_rise_handler);		// create the timer
     APP_ERROR_CHECK(err_code);
+	err_code = app_timer_create(&adxl362_setup_timer_id, APP_TIMER_MODE_SINGLE_SHOT, setupTimerHandler);
+    APP_ERROR_CHECK(err_code);
+	adxl362_timers_created = true;
+}
+
+
+
+/*
+ * Private method for going to the next startMotionInterrupt() step after a delay.
+ * Params: p_state - step, that is waiting
+ *         p_time_ms - delay [ms]
+ */
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::startSetupStep(Setup_state p_state, uint32_t p_time_ms)
+{
+	setup_state = p_state;
+	uint32_t err_code = app_timer_start(adxl362_setup_timer_id, APP_TIMER_TICKS(p_time_ms), this);
+	APP_ERROR_CHECK(err_code);
+}
+
+
+
+/*
+ * Timer handler, runs startMotionInterrupt() steps: VCC discharged -> VCC risen -> soft reset done -> READY.
+ */
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupTimerHandler(void *p_context)
+{
+	Adxl362 *p_adxl = (Adxl362 *)p_context;
+	switch (p_adxl->setup_state)
+	{
+		case Setup_state::DISCHARGING:
+			nrf_gpio_pin_set(p_vcc_pin);		// pull VCC high
+			p_adxl->startSetupStep(Setup_state::RISING, VCC_RISE_TIME);
+			break;
+
+		case Setup_state::RISING:
+			p_adxl->setupSPI();
+			p_adxl->softReset();
+			p_adxl->uninitSPI();
+			p_adxl->startSetupStep(Setup_state::RESETTING, SOFT_RESET_TIME);
+			break;
+
+		case Setup_state::RESETTING:
+			p_adxl->setupSPI();
+			p_adxl->writeSettings(p_adxl->activity_th, p_adxl->inactivity_th, p_adxl->inactivity_time);
+			p_adxl->uninitSPI();
+			p_adxl->setup_state = Setup_state::READY;
+			break;
+
+		default:
+			break;
+	}
 }
 
 
@@ -335,7 +480,7 @@ bool Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::isHung()
 template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
 void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::superviseAcc()
 {
-	if (isHung())
+	if (isReady() && isHung())		// not while startMotionInterrupt() is running
 	{
 		#ifdef ADXL362_DEBUG
 		printf("Acc hung");
@@ -356,6 +501,16 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::supervise
 
 template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
 void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupSensor(uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time)
+{
+	softReset();
+	sleepDelay<SOFT_RESET_TIME>();     // "A latency of approximately 0.5 ms is required after soft reset" ~datasheet P. 26
+	writeSettings(p_act_th, p_inact_th, p_inact_time);
+}
+
+
+// private method for soft resetting adxl362 (SPI has to be set up). Wait SOFT_RESET_TIME before writeSettings().
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::softReset()
 {
 	const uint8_t DO_SOFT_RESET[]     // prepare SPI buffer 1
     {
@@ -365,8 +520,13 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupSens
     };
     uint32_t err_code = nrf_drv_spi_transfer(&spi, DO_SOFT_RESET, sizeof(DO_SOFT_RESET), NULL, 0);	   // transfers will be performed in blocking mode.
     APP_ERROR_CHECK(err_code);
-	sleepDelay<5>();     // "A latency of approximately 0.5 ms is required after soft reset" ~datasheet P. 26
+}
+
 
+// private method for writing motion interrupt settings (SPI has to be set up)
+template <uint8_t p_ss_pin, uint8_t p_mosi_pin, uint8_t p_miso_pin, uint8_t p_sck_pin, uint8_t p_vcc_pin>
+void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::writeSettings(uint8_t p_act_th, uint8_t p_inact_th, uint16_t p_inact_time)
+{
     const uint8_t SENSOR_SETTINGS[]     // prepare SPI buffer 2, in my configuration Adxl362 is placed in wake-up mode, motion interrupt on pin 1
     {
         WRITE_CMD,
@@ -387,7 +547,7 @@ void Adxl362 <p_ss_pin, p_mosi_pin, p_miso_pin, p_sck_pin, p_vcc_pin>::setupSens
         uint8_t(MEASURE_3D | WAKE_UP)    // -------------------------------------------------------------- 0x2D	(POWER_CTL)		
 																									   //  [Alternatively: AUTO_SLEEP | MEASURE_3D, if you want to sample acceleration when motion is detected]
     };
-    err_code = nrf_drv_spi_transfer(&spi, SENSOR_SETTINGS, sizeof(SENSOR_SETTINGS), NULL, 0);	 // no RX buffer needed
+    uint32_t err_code = nrf_drv_spi_transfer(&spi, SENSOR_SETTINGS, sizeof(SENSOR_SETTINGS), NULL, 0);	 // no RX buffer needed
     APP_ERROR_CHECK(err_code);
 }
 
@@ -1,34 +1,75 @@
 #include "Ble_buffer.h"
 
 
+/*
+ * Functions for getting buffer of a frame. Buffer 1 is the next one if use_buffer1, otherwise it is being advertised.
+ * Params: p_buffer1 - true - buffer 1, false - buffer 2
+ */
+template <>
+uint8_t *Ble_buffer::frameData<cfg::Adv_frame>(bool p_buffer1)
+{
+    return p_buffer1 ? my_adv_data_1 : my_adv_data_2;
+}
+
+template <>
+uint8_t *Ble_buffer::frameData<cfg::Scan_frame>(bool p_buffer1)
+{
+    return p_buffer1 ? my_scan_rsp_1 : my_scan_rsp_2;
+}
+
+
+
 /* 
  * Constructor, initializes buffers with data from my_config.h
  */
 Ble_buffer::Ble_buffer()
 {
     use_buffer1 = true;
-    memcpy(my_adv_data_1, cfg::MY_ADV_DATA, cfg::ADV_DATA_L);
-    memcpy(my_adv_data_2, cfg::MY_ADV_DATA, cfg::ADV_DATA_L);
+    dirty = ALL_FIELDS;     // nothing configured yet, the first getBuffer() always switches
+    memcpy(my_adv_data_1, cfg::Adv_frame::data(), cfg::ADV_DATA_L);
+    memcpy(my_adv_data_2, cfg::Adv_frame::data(), cfg::ADV_DATA_L);
+    memcpy(my_scan_rsp_1, cfg::Scan_frame::data(), cfg::SCAN_RSP_DATA_L);
+    memcpy(my_scan_rsp_2, cfg::Scan_frame::data(), cfg::SCAN_RSP_DATA_L);
 
     ble_adv_struct_1.adv_data.p_data = my_adv_data_1;
     ble_adv_struct_1.adv_data.len = cfg::ADV_DATA_L;
-	ble_adv_struct_1.scan_rsp_data.p_data = NULL;
-	ble_adv_struct_1.scan_rsp_data.len = 0;
+	ble_adv_struct_1.scan_rsp_data.p_data = cfg::SCANNABLE_ADVERTISING ? my_scan_rsp_1 : NULL;
+	ble_adv_struct_1.scan_rsp_data.len = cfg::SCANNABLE_ADVERTISING ? cfg::SCAN_RSP_DATA_L : 0;
 
     ble_adv_struct_2.adv_data.p_data = my_adv_data_2;
     ble_adv_struct_2.adv_data.len = cfg::ADV_DATA_L;
-	ble_adv_struct_2.scan_rsp_data.p_data = NULL;
-	ble_adv_struct_2.scan_rsp_data.len = 0;
+	ble_adv_struct_2.scan_rsp_data.p_data = cfg::SCANNABLE_ADVERTISING ? my_scan_rsp_2 : NULL;
+	ble_adv_struct_2.scan_rsp_data.len = cfg::SCANNABLE_ADVERTISING ? cfg::SCAN_RSP_DATA_L : 0;
 }
 
 
 
 /*
- * Function for returning pointer to buffer to be advertised.
- * Returns: pointer to buffer that holds new advertising data.
+ * Function for returning pointer to buffer to be advertised. Buffers are switched only if the new data differs from 
+ * the advertised data, otherwise the update is counted as skipped.
+ * Returns: pointer to buffer that holds new advertising data, NULL if advertised data is already up to date.
  */
 ble_gap_adv_data_t *Ble_buffer::getBuffer()
 {
+    if (dirty == 0)
+    {
+        skipped_count++;
+        return NULL;
+    }
+
+    // fields changed by the previous switch and not written since are stale in the next buffer
+    const uint16_t stale = prev_dirty & ~written;
+    syncField<cfg::Adv_frame, cfg::Pressure_field>(PRESSURE_BIT, stale);
+    syncField<cfg::Adv_frame, cfg::Temperature_field>(TEMPERATURE_BIT, stale);
+    syncField<cfg::Adv_frame, cfg::Battery_field>(BATTERY_BIT, stale);
+    syncField<cfg::Adv_frame, cfg::Status_field>(STATUS_BIT, stale);
+    syncField<cfg::Adv_frame, cfg::Leak_rate_field>(LEAK_RATE_BIT, stale);
+    syncField<cfg::Telemetry_frame, cfg::Pressure_min_field>(PRESSURE_MIN_BIT, stale);
+    syncField<cfg::Telemetry_frame, cfg::Pressure_max_field>(PRESSURE_MAX_BIT, stale);
+    syncField<cfg::Telemetry_frame, cfg::Pressure_avg_field>(PRESSURE_AVG_BIT, stale);
+    syncField<cfg::Telemetry_frame, cfg::Telemetry_leak_rate_field>(TELEMETRY_LEAK_RATE_BIT, stale);
+    syncField<cfg::Telemetry_frame, cfg::Cal_id_field>(CAL_ID_BIT, stale);
+
     ble_gap_adv_data_t *return_value;
     if (use_buffer1)
     {
@@ -38,24 +79,49 @@ ble_gap_adv_data_t *Ble_buffer::getBuffer()
     {
         return_value = &ble_adv_struct_2;
     }
+    setFrame(return_value, frameData<cfg::Adv_frame>(use_buffer1), full_frame);
+    advertised_full_frame = full_frame;
     use_buffer1 = !use_buffer1;
+    prev_dirty = dirty;
+    dirty = 0;
+    written = 0;
+    applied_count++;
     return return_value;
 }
 
 
 
+// Returns number of updates, that switched buffers (and should be configured).
+uint32_t Ble_buffer::getAppliedCount()
+{
+    return applied_count;
+}
+
+
+
+// Returns number of updates skipped, because advertised data was already up to date.
+uint32_t Ble_buffer::getSkippedCount()
+{
+    return skipped_count;
+}
+
+
+
 /*
  * Function for updating Ble_buffer with new data.
  * Params: p_pressure - new pressure to be advertised in [kPa]
  *		   p_temperature - new temperature to be advertised in [1/100 *C]
  *         p_bat_percentage - new battery percentage to be advertised
  *         p_leak - new pressure leak flag to be advertised [true - leak detected, false - not].
+ *         p_leak_rate - new pressure change rate to be advertised in [0.1kPa/h]
  */
-void Ble_buffer::setPressTempLeak(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage)
+void Ble_buffer::setPressTempLeak(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage, 
+                                  const bool p_leak, const int16_t p_leak_rate)
 {
     setPressure(p_pressure);
     setTemp(p_temperature);
     setBat(p_bat_percentage);
+    setLeak(p_leak, p_leak_rate);
 }
 
 
@@ -66,58 +132,191 @@ void Ble_buffer::setPressTempLeak(const uint16_t p_pressure, const int16_t p_tem
  */
 void Ble_buffer::setPressure(uint16_t p_pressure)
 {
-    p_pressure = p_pressure;      // sensors send pressure in 1/1000 kPa units. App remaps it.
-    if (use_buffer1)
+    setField<cfg::Adv_frame, cfg::Pressure_field>(PRESSURE_BIT, p_pressure);
+}
+
+
+
+/*
+ * Function for updating Ble_buffer with new temperature data.
+ * Params: p_temp - new temperature to be advertised in [1/100 *C]
+ */
+void Ble_buffer::setTemp(int16_t p_temp)
+{
+    setField<cfg::Adv_frame, cfg::Temperature_field>(TEMPERATURE_BIT, p_temp);
+}
+
+
+
+/*
+ * Function for updating Ble_buffer with new bat percentage data.
+ * Params: p_percentage - new bat percentage to be advertised in [%]
+ */
+void Ble_buffer::setBat(uint8_t p_percentage)
+{
+    if (p_percentage > 100)     // check for reasonability. Btw Android app crashes if the battery percentage is >100%...
+    {
+        return;
+    }
+    setField<cfg::Adv_frame, cfg::Battery_field>(BATTERY_BIT, p_percentage);
+}
+
+
+
+/*
+ * Function for updating Ble_buffer with new leak data.
+ * Params: p_leak - new pressure leak flag [true - leak detected, false - not]
+ *         p_leak_rate - new pressure change rate in [0.1kPa/h]
+ */
+void Ble_buffer::setLeak(bool p_leak, int16_t p_leak_rate)
+{
+    setStatusFlag(LEAK_FLAG, p_leak);
+    setField<cfg::Adv_frame, cfg::Leak_rate_field>(LEAK_RATE_BIT, p_leak_rate);
+}
+
+
+
+/*
+ * Function for updating Ble_buffer with new alert flag. Call before setPressTempLeak().
+ * Params: p_alert - new rapid deflation alert flag [true - alert, false - not]
+ */
+void Ble_buffer::setAlert(bool p_alert)
+{
+    setStatusFlag(ALERT_FLAG, p_alert);
+}
+
+
+
+/*
+ * Function for choosing frame to be advertised. Compact frame is a part of the full frame (without the name, 
+ * see COMPACT_FRAME in my_config.h), so switching only changes data pointer and length.
+ * Params: p_full - true - full frame, false - compact frame
+ */
+void Ble_buffer::setFullFrame(bool p_full)
+{
+    full_frame = p_full;
+    if (full_frame != advertised_full_frame)
     {
-        my_adv_data_1[PRESS_POS] = p_pressure & 0x00FF;    // lower byte
-        my_adv_data_1[PRESS_POS + 1] = (p_pressure & 0xFF00) >> 8;      // higher byte
+        dirty |= FRAME_BIT;
     }
     else
     {
-        my_adv_data_2[PRESS_POS] = p_pressure & 0x00FF;    // lower byte
-        my_adv_data_2[PRESS_POS + 1] = (p_pressure & 0xFF00) >> 8;      // higher byte
+        dirty &= ~FRAME_BIT;
     }
 }
 
 
 
+/*
+ * Function for pointing advertising data struct at full or compact frame in its buffer.
+ * Params: p_adv_struct - advertising data struct
+ *         p_data - buffer of the struct
+ *         p_full - true - full frame, false - compact frame
+ */
+void Ble_buffer::setFrame(ble_gap_adv_data_t *p_adv_struct, uint8_t *p_data, bool p_full)
+{
+    if (p_full)
+    {
+        p_adv_struct->adv_data.p_data = p_data;
+        p_adv_struct->adv_data.len = cfg::ADV_DATA_L;
+    }
+    else
+    {
+        p_adv_struct->adv_data.p_data = p_data + cfg::COMPACT_FRAME_START;
+        p_adv_struct->adv_data.len = cfg::COMPACT_FRAME_L;
+    }
+}
+
+
 
 /*
- * Function for updating Ble_buffer with new temperature data.
- * Params: p_temp - new temperature to be advertised in [1/100 *C]
+ * Function for setting or clearing a bit in the status byte.
+ * Params: p_flag - status flag bit mask
+ *         p_set - true - set the bit, false - clear it
  */
-void Ble_buffer::setTemp(int16_t p_temp)
+void Ble_buffer::setStatusFlag(uint8_t p_flag, bool p_set)
 {
-    if (use_buffer1)
+    if (p_set)
     {
-        my_adv_data_1[TEMP_POS] = p_temp & 0x00FF;         // lower byte
-        my_adv_data_1[TEMP_POS + 1] = (p_temp & 0xFF00) >> 8;     // higher byte
+        status |= p_flag;
     }
     else
     {
-        my_adv_data_2[TEMP_POS] = p_temp & 0x00FF;         // lower byte
-        my_adv_data_2[TEMP_POS + 1] = (p_temp & 0xFF00) >> 8;     // higher byte
+        status &= ~p_flag;
     }
+    setField<cfg::Adv_frame, cfg::Status_field>(STATUS_BIT, status);
 }
 
 
 
 /*
- * Function for updating Ble_buffer with new bat percentage data.
- * Params: p_percentage - new bat percentage to be advertised in [%]
+ * Function for updating extended telemetry (scan response, or advertising data in extended advertising). Used only if ADV_TELEMETRY.
+ * Params: p_pressure_min - minimal pressure since wake up in [kPa]
+ *         p_pressure_max - maximal pressure since wake up in [kPa]
+ *         p_pressure_avg - average pressure since wake up in [kPa]
+ *         p_leak_rate - pressure change rate in [0.1kPa/h]
  */
-void Ble_buffer::setBat(uint8_t p_percentage)
+void Ble_buffer::setTelemetry(uint16_t p_pressure_min, uint16_t p_pressure_max, uint16_t p_pressure_avg, int16_t p_leak_rate)
 {
-    if (p_percentage > 100)     // check for reasonability. Btw Android app crashes if the battery percentage is >100%...
+    if (!cfg::ADV_TELEMETRY)
     {
         return;
     }
-    if (use_buffer1)
+    setField<cfg::Telemetry_frame, cfg::Pressure_min_field>(PRESSURE_MIN_BIT, p_pressure_min);
+    setField<cfg::Telemetry_frame, cfg::Pressure_max_field>(PRESSURE_MAX_BIT, p_pressure_max);
+    setField<cfg::Telemetry_frame, cfg::Pressure_avg_field>(PRESSURE_AVG_BIT, p_pressure_avg);
+    setField<cfg::Telemetry_frame, cfg::Telemetry_leak_rate_field>(TELEMETRY_LEAK_RATE_BIT, p_leak_rate);
+}
+
+
+
+/*
+ * Function for setting calibration table id advertised in extended telemetry. Used only if ADV_TELEMETRY.
+ * Params: p_cal_id - calibration table id
+ */
+void Ble_buffer::setCalibrationId(uint16_t p_cal_id)
+{
+    if (!cfg::ADV_TELEMETRY)
     {
-        my_adv_data_1[BAT_POS] = p_percentage;
+        return;
+    }
+    setField<cfg::Telemetry_frame, cfg::Cal_id_field>(CAL_ID_BIT, p_cal_id);
+}
+
+
+
+/*
+ * Function for writing a field into the next buffer. Field is marked dirty if it differs from the advertised buffer.
+ * Params: p_bit - field bit for dirty tracking
+ *         p_value - new field value
+ */
+template <class FRAME, class TAG>
+void Ble_buffer::setField(uint16_t p_bit, typename TAG::type p_value)
+{
+    FRAME::template set<TAG>(frameData<FRAME>(use_buffer1), p_value);
+    written |= p_bit;
+    if (FRAME::template get<TAG>(frameData<FRAME>(!use_buffer1)) != p_value)
+    {
+        dirty |= p_bit;
     }
     else
     {
-        my_adv_data_2[BAT_POS] = p_percentage;
+        dirty &= ~p_bit;
+    }
+}
+
+
+
+/*
+ * Function for copying a field from the advertised buffer into the next buffer, if it is stale.
+ * Params: p_bit - field bit for dirty tracking
+ *         p_stale - stale fields
+ */
+template <class FRAME, class TAG>
+void Ble_buffer::syncField(uint16_t p_bit, uint16_t p_stale)
+{
+    if (p_stale & p_bit)
+    {
+        FRAME::template set<TAG>(frameData<FRAME>(use_buffer1), FRAME::template get<TAG>(frameData<FRAME>(!use_buffer1)));
     }
 }
@@ -7,28 +7,71 @@
 #include <stdint.h>
 
 /* Class wrapping ble buffer. nrf SDK requires switching buffers to update advertising. This class does this. 
- * Everytime getBuffer() is called internal buffer is switched for the next update. 
+ * Setters write into the next buffer (the one not being advertised) and track which fields differ from the advertised
+ * buffer. getBuffer() switches buffers only if something changed, so byte-identical updates don't reach the SoftDevice.
+ * Fields changed in the previous update are resynced into the next buffer field by field, not by copying whole buffers.
+ * Scan response (SCANNABLE_ADVERTISING) is double buffered and tracked the same way, together with advertising data.
+ * Extended telemetry goes to the scan response, or to advertising data in EXTENDED_ADVERTISING (cfg::Telemetry_frame).
  */
 class Ble_buffer
 {
+    const uint8_t LEAK_FLAG = 0x01;     // status flags bits
+    const uint8_t ALERT_FLAG = 0x02;
+
+    // field bits for dirty tracking
+    static const uint16_t PRESSURE_BIT = 0x0001;
+    static const uint16_t TEMPERATURE_BIT = 0x0002;
+    static const uint16_t BATTERY_BIT = 0x0004;
+    static const uint16_t STATUS_BIT = 0x0008;
+    static const uint16_t LEAK_RATE_BIT = 0x0010;
+    static const uint16_t FRAME_BIT = 0x0020;     // full / compact frame
+    static const uint16_t PRESSURE_MIN_BIT = 0x0040;     // extended telemetry fields
+    static const uint16_t PRESSURE_MAX_BIT = 0x0080;
+    static const uint16_t PRESSURE_AVG_BIT = 0x0100;
+    static const uint16_t TELEMETRY_LEAK_RATE_BIT = 0x0200;
+    static const uint16_t CAL_ID_BIT = 0x0400;
+    static const uint16_t ALL_FIELDS = 0x07FF;
 
-    const uint8_t PRESS_POS = 12;	  // index of bytes representing pressure in advertising buffer
-    const uint8_t TEMP_POS = 14;
-    const uint8_t BAT_POS = 16;
     bool use_buffer1;      // bool used to toggle between buffers.
     uint8_t my_adv_data_1[cfg::ADV_DATA_L];      // advertising data buffer 1. 
     uint8_t my_adv_data_2[cfg::ADV_DATA_L];      // advertising data buffer 2.
+    uint8_t my_scan_rsp_1[cfg::SCAN_RSP_DATA_L];      // scan response buffer 1 (used only if SCANNABLE_ADVERTISING)
+    uint8_t my_scan_rsp_2[cfg::SCAN_RSP_DATA_L];      // scan response buffer 2
     ble_gap_adv_data_t ble_adv_struct_1;
     ble_gap_adv_data_t ble_adv_struct_2;
+    uint8_t status = 0;     // status flags to be advertised
+    bool full_frame = true;     // frame to be advertised, full or compact
+    bool advertised_full_frame = true;
+    uint16_t dirty;     // fields, that differ from the advertised buffer
+    uint16_t written = 0;     // fields written into the next buffer since the last switch
+    uint16_t prev_dirty = 0;     // fields changed by the last switch (stale in the next buffer, unless written)
+    uint32_t applied_count = 0;
+    uint32_t skipped_count = 0;
 
     void setPressure(uint16_t p_pressure);
     void setTemp(int16_t p_temp);
     void setBat(uint8_t p_temp);
+    void setLeak(bool p_leak, int16_t p_leak_rate);
+    void setStatusFlag(uint8_t p_flag, bool p_set);
+    void setFrame(ble_gap_adv_data_t *p_adv_struct, uint8_t *p_data, bool p_full);
+    template <class FRAME>
+    uint8_t *frameData(bool p_buffer1);
+    template <class FRAME, class TAG>
+    void setField(uint16_t p_bit, typename TAG::type p_value);
+    template <class FRAME, class TAG>
+    void syncField(uint16_t p_bit, uint16_t p_stale);
 
   public:
     Ble_buffer();
     ble_gap_adv_data_t *getBuffer();
-    void setPressTempLeak(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage);
+    void setAlert(bool p_alert);
+    void setFullFrame(bool p_full);
+    void setTelemetry(uint16_t p_pressure_min, uint16_t p_pressure_max, uint16_t p_pressure_avg, int16_t p_leak_rate);
+    void setCalibrationId(uint16_t p_cal_id);
+    void setPressTempLeak(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage, 
+                          const bool p_leak, const int16_t p_leak_rate);
+    uint32_t getAppliedCount();
+    uint32_t getSkippedCount();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,92 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+//#define BOOT_TIMELINE_DEBUG     // when defined, print() prints boot phase times
+
+#include <stdbool.h>
+#include <stdint.h>
+extern "C" {
+#include "app_timer.h"
+}
+#ifdef BOOT_TIMELINE_DEBUG
+#include <stdio.h>
+#endif
+
+
+// Boot phases, in the order they normally end.
+enum class Boot_phase : uint8_t
+{
+    SOFTDEVICE_ENABLED,     // LFCLK runs, so time is counted from here on
+    CALIBRATION_STARTED,
+    FIRST_READING,     // values for the first advertisement are ready (read, or retained on warm start)
+    ADVERTISING_STARTED,     // time to first advertisement
+    STORAGE_READY,     // FDS initialized, flash history loaded
+    SETUP_DONE,     // main loop entered
+    ACC_READY,     // accelerometer set up in background
+    COUNT
+};
+
+
+
+/*
+ * Class for recording when boot phases end, so changes of time to first advertisement are measurable.
+ * Times are app_timer ticks (RTC1 is kept running, APP_TIMER_KEEPS_RTC_ACTIVE) and count from LFCLK start,
+ * which is done when the SoftDevice is enabled. Only the first mark() of every phase counts.
+ * Read them with getMs() in debugger, or print() with BOOT_TIMELINE_DEBUG.
+ */
+class Boot_timeline
+{
+    static const uint8_t PHASES = (uint8_t)Boot_phase::COUNT;
+    // app_timer tick rate, RTC1 counts LFCLK divided by the prescaler (APP_TIMER_CONFIG_RTC_FREQUENCY + 1) [Hz]
+    static const uint32_t TICKS_PER_SECOND = APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1);
+
+    uint32_t ticks[PHASES];
+    bool marked[PHASES] = {};
+
+  public:
+
+    // Marks the end of a phase now. Params: p_phase - the phase
+    void mark(Boot_phase p_phase)
+    {
+        const uint8_t i = (uint8_t)p_phase;
+        if (!marked[i])
+        {
+            ticks[i] = app_timer_cnt_get();
+            marked[i] = true;
+        }
+    }
+
+
+    // Returns true if the phase has ended. Params: p_phase - the phase
+    bool isMarked(Boot_phase p_phase)
+    {
+        return marked[(uint8_t)p_phase];
+    }
+
+
+    /*
+     * Returns time from LFCLK start to the end of a phase [ms], 0 if it hasn't ended.
+     * Params: p_phase - the phase
+     */
+    uint32_t getMs(Boot_phase p_phase)
+    {
+        const uint8_t i = (uint8_t)p_phase;
+        return marked[i] ? (uint64_t)ticks[i] * 1000 / TICKS_PER_SECOND : 0;
+    }
+
+
+    // Prints times of all phases (only with BOOT_TIMELINE_DEBUG).
+    void print()
+    {
+#ifdef BOOT_TIMELINE_DEBUG
+        static const char *const NAMES[PHASES] = {"softdevice", "calibration", "first reading", "advertising",
+                                                  "storage", "setup", "accelerometer"};
+        for (uint8_t i = 0; i < PHASES; i++)
+        {
+            printf("boot %s: %lu ms\n", NAMES[i], (unsigned long)getMs((Boot_phase)i));
+        }
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef CALIBRATION_SCHEDULER_H
+#define CALIBRATION_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "nrf_pwr_mgmt.h"
+#include "my_utility.h"
+
+
+/*
+ * Class for scheduling ADC offset calibration without blocking. Calibration is requested when temperature changes,
+ * but only started in a radio idle window (or after MAX_DEFERRALS deferrals, so it can't be postponed forever).
+ * It runs in background (SAADC interrupt) and is finished before the next reading.
+ *
+ * Every time calibration starts, the offset accumulated since the last one is measured, so the scheduler learns how fast
+ * the offset drifts with temperature. Temperature threshold for the next calibration is the swing, that causes
+ * p_allowed_drift offset, clamped to <MIN_THRESHOLD, MAX_THRESHOLD>.
+ *
+ * States: IDLE -> (request()) -> PENDING -> (start()) -> RUNNING -> (finish()) -> IDLE
+ *
+ * Template parameters:
+ * MIN_THRESHOLD, MAX_THRESHOLD - allowed range of calibration temperature threshold [1/100 *C]
+ * MAX_DEFERRALS - how many times calibration can be deferred, because radio wasn't idle
+ */
+template <int16_t MIN_THRESHOLD, int16_t MAX_THRESHOLD, uint8_t MAX_DEFERRALS>
+class Calibration_scheduler
+{
+    enum class State
+    {
+        IDLE,
+        PENDING,
+        RUNNING,
+    };
+
+    State state = State::IDLE;
+    uint8_t deferrals = 0;
+    int16_t threshold;     // current temperature threshold [1/100 *C]
+    int16_t allowed_drift;     // offset drift [raw] tolerated between calibrations
+    int16_t last_cal_temperature;
+    bool has_last_cal = false;
+    int32_t drift_rate_q16 = 0;     // learned offset drift [raw / (1/100 *C)], Q16
+    bool has_drift_rate = false;
+
+  public:
+
+    /*
+     * Constructor.
+     * Params: p_initial_threshold - threshold used until the drift is learned [1/100 *C]
+     *         p_allowed_drift - offset drift tolerated between calibrations, in raw SAADC units
+     */
+    Calibration_scheduler(int16_t p_initial_threshold, int16_t p_allowed_drift)
+    {
+        threshold = p_initial_threshold;
+        allowed_drift = p_allowed_drift;
+        last_cal_temperature = 0;
+    }
+
+
+    // Marks calibration as needed. It is started by start() later, when it is convenient.
+    void request()
+    {
+        if (state == State::IDLE)
+        {
+            state = State::PENDING;
+            deferrals = 0;
+        }
+    }
+
+
+    /*
+     * Checks if requested calibration should start now.
+     * Params: p_radio_idle - true if the radio is idle now (calibration doesn't overlap radio activity)
+     * Returns: true if start() should be called now. If false, calibration is deferred.
+     */
+    bool shouldStart(bool p_radio_idle)
+    {
+        if (state != State::PENDING)
+        {
+            return false;
+        }
+        if (p_radio_idle || deferrals >= MAX_DEFERRALS)
+        {
+            return true;
+        }
+        deferrals++;
+        return false;
+    }
+
+
+    /*
+     * Measures offset drift and starts calibration in background. SAADC is busy until finish().
+     * Params: p_adc - adc object
+     *         p_temperature - current temperature [1/100 *C]
+     */
+    template <class Adc>
+    void start(Adc &p_adc, int16_t p_temperature)
+    {
+        if (has_last_cal)
+        {
+            learnDrift(abs(p_adc.measureOffset()), abs(p_temperature - last_cal_temperature));
+        }
+        last_cal_temperature = p_temperature;
+        has_last_cal = true;
+        p_adc.startCalibration();
+        state = State::RUNNING;
+    }
+
+
+    /*
+     * Finishes calibration, if it is running. Call before using adc for a reading. If calibration hasn't finished
+     * yet, CPU sleeps until it does (normally it has finished long before).
+     */
+    template <class Adc>
+    void finish(Adc &p_adc)
+    {
+        if (state != State::RUNNING)
+        {
+            return;
+        }
+        while (!p_adc.isConversionDone())
+        {
+            nrf_pwr_mgmt_run();
+        }
+        p_adc.finishCalibration();
+        state = State::IDLE;
+    }
+
+
+    // Returns true if calibration is requested, but not started yet.
+    bool isPending()
+    {
+        return state == State::PENDING;
+    }
+
+
+    // Returns temperature threshold [1/100 *C], that should trigger the next calibration.
+    int16_t getThreshold()
+    {
+        return threshold;
+    }
+
+
+  private:
+
+    /*
+     * Updates learned drift rate with a new observation and recalculates threshold.
+     * Params: p_drift - offset drift since the last calibration [raw]
+     *         p_temperature_change - temperature change since the last calibration [1/100 *C]
+     */
+    void learnDrift(int32_t p_drift, int32_t p_temperature_change)
+    {
+        if (p_temperature_change == 0)
+        {
+            return;
+        }
+        int32_t rate_q16 = (p_drift << 16) / p_temperature_change;
+        if (has_drift_rate)
+        {
+            drift_rate_q16 += (rate_q16 - drift_rate_q16) / 4;     // moving average, so a single noisy measurement doesn't matter much
+        }
+        else
+        {
+            drift_rate_q16 = rate_q16;
+            has_drift_rate = true;
+        }
+
+        if (drift_rate_q16 <= 0)
+        {
+            threshold = MAX_THRESHOLD;     // no measurable drift
+        }
+        else
+        {
+            int32_t new_threshold = ((int32_t)allowed_drift << 16) / drift_rate_q16;
+            threshold = (int16_t)constrain(new_threshold, (int32_t)MIN_THRESHOLD, (int32_t)MAX_THRESHOLD);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef CALIBRATION_TABLE_H
+#define CALIBRATION_TABLE_H
+
+#include <stdint.h>
+#include "my_config.h"
+#include "my_utility.h"
+extern "C" {
+#include "crc16.h"
+}
+
+
+const uint32_t CAL_FLASH_MAGIC = 0x43414C31;     // "CAL1", marks a valid table in flash
+
+
+// Layout of the factory calibration page at cfg::CAL_FLASH_ADDRESS.
+struct Cal_flash_image
+{
+    uint32_t magic;
+    uint16_t id;     // calibration id, reported for diagnostics
+    uint16_t crc;     // crc16_compute() of id and table
+    int16_t table[cfg::CAL_TEMP_POINTS][cfg::CAL_RAW_POINTS];
+};
+
+
+
+// Checks if a row of calibration table is strictly increasing. Compile time only.
+constexpr bool calRowIncreasing(const int16_t *p_row, uint8_t p_count)
+{
+    return p_count < 2 || (p_row[0] < p_row[1] && calRowIncreasing(p_row + 1, p_count - 1));
+}
+
+// Checks if all rows of calibration table are strictly increasing. Compile time only.
+constexpr bool calTableIncreasing(uint8_t p_rows)
+{
+    return p_rows == 0 || (calRowIncreasing(cfg::CAL_TABLE_DKPA[p_rows - 1], cfg::CAL_RAW_POINTS) && calTableIncreasing(p_rows - 1));
+}
+
+static_assert(cfg::CAL_RAW_POINTS >= 2 && cfg::CAL_TEMP_POINTS >= 2, "calibration table needs at least 2x2 points");
+static_assert(calTableIncreasing(cfg::CAL_TEMP_POINTS), "calibration table rows have to increase with raw reading");
+
+
+
+/*
+ * Class for mapping raw pressure readings to kPa with temperature compensation. Pressure is interpolated bilinearly from
+ * a 2-D table (raw reading x die temperature), so sensor non-linearity and temperature drift are compensated,
+ * which a single linear fit (map()) can't do.
+ *
+ * Raw axis step is a power of 2, so finding the cell is a shift. Everything is integer math (one 64-bit multiply).
+ * Readings outside the table are clamped to its edges.
+ *
+ * The table comes from cfg::CAL_TABLE_DKPA, unless a valid factory table is found in flash at cfg::CAL_FLASH_ADDRESS.
+ * The table from my_config.h is only used if cfg::CAL_TABLE_MAPPING, otherwise pressure is mapped by the linear fit
+ * (isUsed() returns false) unless a factory table is loaded.
+ */
+class Calibration_table
+{
+    static const int32_t RAW_SPAN = (int32_t)(cfg::CAL_RAW_POINTS - 1) << cfg::CAL_RAW_STEP_SHIFT;
+    static const int32_t TEMP_SPAN = (int32_t)(cfg::CAL_TEMP_POINTS - 1) * cfg::CAL_TEMP_STEP;
+
+    const int16_t (*table)[cfg::CAL_RAW_POINTS] = cfg::CAL_TABLE_DKPA;
+    uint16_t id = 0;     // 0 - table compiled in
+    bool loaded = false;     // factory table from flash is used
+
+    /*
+     * Finds temperature row and position between rows.
+     * Params: p_temperature - temperature [1/100 *C]
+     *         p_row - returns lower row index
+     *         p_fraction - returns distance from the lower row [1/100 *C], 0 to CAL_TEMP_STEP
+     */
+    void findRow(int32_t p_temperature, uint8_t &p_row, int32_t &p_fraction)
+    {
+        int32_t t = constrain(p_temperature - cfg::CAL_TEMP_MIN, (int32_t)0, TEMP_SPAN);
+        p_row = (uint8_t)(t / cfg::CAL_TEMP_STEP);
+        if (p_row >= cfg::CAL_TEMP_POINTS - 1)
+        {
+            p_row = cfg::CAL_TEMP_POINTS - 2;
+        }
+        p_fraction = t - (int32_t)p_row * cfg::CAL_TEMP_STEP;
+    }
+
+  public:
+
+    /*
+     * Loads factory calibration table from flash, if there is a valid one. Otherwise table from my_config.h is used.
+     * Call once during startup.
+     */
+    void load()
+    {
+        load((const Cal_flash_image *)cfg::CAL_FLASH_ADDRESS);
+    }
+
+
+    /*
+     * Uses a factory calibration table, if it is valid: magic and crc match, and all rows increase with raw reading
+     * (a bridge can't read lower pressure at a higher output). Otherwise the table in use doesn't change.
+     * Params: p_image - factory calibration image (must stay valid while the table is used)
+     * Returns: true if the table was taken
+     */
+    bool load(const Cal_flash_image *p_image)
+    {
+        if (p_image->magic != CAL_FLASH_MAGIC)
+        {
+            return false;
+        }
+        uint16_t crc = crc16_compute((const uint8_t *)&p_image->id, sizeof(p_image->id), NULL);
+        crc = crc16_compute((const uint8_t *)p_image->table, sizeof(p_image->table), &crc);
+        if (crc != p_image->crc)
+        {
+            return false;
+        }
+        for (uint8_t row = 0; row < cfg::CAL_TEMP_POINTS; row++)
+        {
+            if (!calRowIncreasing(p_image->table[row], cfg::CAL_RAW_POINTS))
+            {
+                return false;
+            }
+        }
+        table = p_image->table;
+        id = p_image->id;
+        loaded = true;
+        return true;
+    }
+
+
+    // Returns true if pressure should be mapped by the table: a factory table is loaded, or cfg::CAL_TABLE_MAPPING.
+    bool isUsed()
+    {
+        return cfg::CAL_TABLE_MAPPING || loaded;
+    }
+
+
+    // Returns id of the calibration in use (0 if the table from my_config.h is used).
+    uint16_t getId()
+    {
+        return id;
+    }
+
+
+    /*
+     * Function for mapping pressure, like map(), but with temperature compensation.
+     * Params: p_pressure_raw - raw pressure reading from adc
+     *         p_temperature - die temperature from getTemperature() [1/100 *C]
+     * Returns: pressure in kPa (0 below 20kPa, like map())
+     */
+    uint16_t map(uint16_t p_pressure_raw, int32_t p_temperature)
+    {
+        int32_t r = constrain((int32_t)p_pressure_raw - cfg::CAL_RAW_MIN, (int32_t)0, RAW_SPAN);
+        uint8_t column = (uint8_t)(r >> cfg::CAL_RAW_STEP_SHIFT);
+        if (column >= cfg::CAL_RAW_POINTS - 1)
+        {
+            column = cfg::CAL_RAW_POINTS - 2;
+        }
+        int32_t raw_fraction = r - ((int32_t)column << cfg::CAL_RAW_STEP_SHIFT);
+
+        uint8_t row;
+        int32_t temp_fraction;
+        findRow(p_temperature, row, temp_fraction);
+
+        // interpolate along raw axis in both rows (scaled by raw step), then between rows
+        const int16_t *low_row = table[row];
+        const int16_t *high_row = table[row + 1];
+        int32_t low = ((int32_t)low_row[column] << cfg::CAL_RAW_STEP_SHIFT) + (low_row[column + 1] - low_row[column]) * raw_fraction;
+        int32_t high = ((int32_t)high_row[column] << cfg::CAL_RAW_STEP_SHIFT) + (high_row[column + 1] - high_row[column]) * raw_fraction;
+        int32_t scaled = low + (int32_t)((int64_t)(high - low) * temp_fraction / cfg::CAL_TEMP_STEP);
+
+        int32_t result = (scaled >> cfg::CAL_RAW_STEP_SHIFT) / 10;     // 0.1kPa -> kPa
+        if (result < 20)     // the same as map()
+            result = 0;
+        return (uint16_t)result;
+    }
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef DEFLATION_DETECTOR_H
+#define DEFLATION_DETECTOR_H
+
+#include <stdint.h>
+
+
+/*
+ * Class for detecting rapid deflation (puncture) with one-sided CUSUM over time. Every reading adds its drop below
+ * the reference pressure, less DRIFT_KPA, weighted by the time since the previous reading. Noise keeps the sum near 0,
+ * while a real pressure drop accumulates quickly: a drop of d kPa raises an alert after ~THRESHOLD_KPA_S / (d - DRIFT_KPA)
+ * seconds, the same at any sampling interval up to MAX_WEIGHT_MS (faster sampling only averages more noise out).
+ * A reading never weighs more than MAX_WEIGHT_MS, so at slow (parked) intervals a single noisy reading doesn't count
+ * for seconds. A real drop is a change of readings, so sampling becomes fast again anyway (samplingPolicy()).
+ *
+ * Reference pressure follows readings slowly, but only while the sum is 0 (no drop in progress).
+ * Alert is held for HOLD_MS after the last alarm.
+ *
+ * Template parameters:
+ * DRIFT_KPA - drop below the reference, that is still considered noise [kPa], the sum drains by it every second
+ * THRESHOLD_KPA_S - accumulated drop, that raises an alert [kPa * s]
+ * HOLD_MS - time the alert lasts after the drop stops [ms]
+ */
+template <int16_t DRIFT_KPA, int16_t THRESHOLD_KPA_S, uint32_t HOLD_MS>
+class Deflation_detector
+{
+    static const uint8_t REFERENCE_SHIFT = 3;     // reference follows readings with 1/8 weight
+    static const uint32_t MAX_WEIGHT_MS = 1000;
+
+    int32_t reference_q8;     // reference pressure [kPa * 256]
+    int32_t sum = 0;     // accumulated drop [kPa * ms]
+    uint32_t hold_ms = 0;     // time left until the alert ends
+
+  public:
+
+    // Constructor. Params: p_pressure_kPa - initial reference pressure
+    Deflation_detector(uint16_t p_pressure_kPa)
+    {
+        reference_q8 = (int32_t)p_pressure_kPa << 8;
+    }
+
+
+    /*
+     * Call with every pressure reading. Give it the mapped reading, not a held or filtered value: a held value (like
+     * the advertised pressure) doesn't drop with the tire, so the sum wouldn't grow until the value is updated.
+     * Params: p_pressure_kPa - pressure reading [kPa]
+     *         p_elapsed_ms - time since the previous reading [ms]
+     * Returns: true if the alert has just been raised (only on the reading, that raises it)
+     */
+    bool update(uint16_t p_pressure_kPa, uint32_t p_elapsed_ms)
+    {
+        const int32_t reading_q8 = (int32_t)p_pressure_kPa << 8;
+        const int32_t weight_ms = (p_elapsed_ms < MAX_WEIGHT_MS) ? p_elapsed_ms : MAX_WEIGHT_MS;
+        sum += (((reference_q8 - reading_q8) >> 8) - DRIFT_KPA) * weight_ms;
+        if (sum < 0)
+        {
+            sum = 0;
+        }
+
+        if (sum == 0)
+        {
+            reference_q8 += (reading_q8 - reference_q8) >> REFERENCE_SHIFT;
+        }
+
+        if (sum > (int32_t)THRESHOLD_KPA_S * 1000)
+        {
+            const bool raised = (hold_ms == 0);
+            hold_ms = HOLD_MS;
+            reference_q8 = reading_q8;     // look for a further drop from here
+            sum = 0;
+            return raised;
+        }
+
+        hold_ms = (hold_ms > p_elapsed_ms) ? hold_ms - p_elapsed_ms : 0;
+        return false;
+    }
+
+
+    // Returns true while the alert lasts.
+    bool isAlert()
+    {
+        return hold_ms > 0;
+    }
+};
+
+#endif
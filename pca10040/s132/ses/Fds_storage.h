@@ -0,0 +1,307 @@
+#ifndef FDS_STORAGE_H
+#define FDS_STORAGE_H
+
+#include <stdint.h>
+#include <string.h>
+extern "C" {
+#include "fds.h"
+#include "app_error.h"
+#include "nrf_atomic.h"
+#include "nrf_pwr_mgmt.h"
+}
+
+
+// state shared with fdsEventHandler()
+struct Fds_storage_state
+{
+    volatile bool init_done;
+    nrf_atomic_u32_t pending;     // operations queued, but not finished (changed from main and SoftDevice interrupt)
+    volatile uint32_t write_errors;
+};
+
+static Fds_storage_state fds_storage_state = {false, 0, 0};
+
+
+
+/*
+ * FDS event handler. Called from SoftDevice event interrupt, when a queued operation finishes.
+ */
+static void fdsEventHandler(fds_evt_t const *p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            APP_ERROR_CHECK(p_evt->result);
+            fds_storage_state.init_done = true;
+            break;
+
+        case FDS_EVT_WRITE:
+            if (p_evt->result != NRF_SUCCESS)
+            {
+                fds_storage_state.write_errors++;
+            }
+            nrf_atomic_u32_sub(&fds_storage_state.pending, 1);
+            break;
+
+        case FDS_EVT_DEL_RECORD:
+        case FDS_EVT_GC:
+            nrf_atomic_u32_sub(&fds_storage_state.pending, 1);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+
+/*
+ * Class for storing blocks of words as FDS records (all in one file). FDS operations are asynchronous: written data
+ * must stay untouched until isBusy() returns false. FDS spreads writes over its virtual pages and garbage collection
+ * erases them in turns, so wear is levelled by FDS itself.
+ *
+ * Garbage collection erases every page with a removed record, but first copies the records still valid on it to the
+ * swap page. collectGarbage() returns how many bytes that programs, so they can be counted as writes. Pages of removed
+ * records are found from record addresses, which works because this is the only FDS user.
+ *
+ * This is the flash backend of Flash_history. Any class with the same methods can be used instead (for example
+ * a RAM simulation of flash on a host).
+ */
+class Fds_storage
+{
+    static const uint16_t FILE_ID = 0x4854;     // "HT"
+    static const uint16_t RECORD_KEY = 0x0001;     // every block has the same key, blocks are told apart by their contents
+    static const uint8_t PAGE_TAG_L = 8;     // bytes FDS writes to tag an erased page as the new swap page
+    static const uint32_t PAGE_BYTES = FDS_VIRTUAL_PAGE_SIZE * 4;
+
+    fds_find_token_t find_token;
+    uint8_t dirty_pages[FDS_VIRTUAL_PAGES];     // pages (flash address / PAGE_BYTES) with removed records, collected by the next GC
+    uint8_t dirty_count = 0;
+
+
+    // Starts counting an operation. It is counted before it is queued, so its event can't come first.
+    static void startOperation()
+    {
+        nrf_atomic_u32_add(&fds_storage_state.pending, 1);
+    }
+
+
+    // Stops counting an operation, that couldn't be queued.
+    static void cancelOperation()
+    {
+        nrf_atomic_u32_sub(&fds_storage_state.pending, 1);
+    }
+
+
+    /*
+     * Finds flash page of a record.
+     * Params: p_record_id - id of the record
+     *         p_page - output, flash page number
+     *         p_bytes - output, bytes the record takes in flash (header included)
+     * Returns: false if there is no such record
+     */
+    static bool locate(uint32_t p_record_id, uint8_t &p_page, uint32_t &p_bytes)
+    {
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.record_id = p_record_id;
+        fds_flash_record_t flash_record;
+        if (fds_record_open(&desc, &flash_record) != NRF_SUCCESS)
+        {
+            return false;
+        }
+        p_page = (uint8_t)((uint32_t)flash_record.p_header / PAGE_BYTES);
+        p_bytes = flash_record.p_header->length_words * 4 + RECORD_HEADER_L;
+        fds_record_close(&desc);
+        return true;
+    }
+
+
+    // Returns true if page p_page has removed records.
+    bool isDirty(uint8_t p_page)
+    {
+        for (uint8_t i = 0; i < dirty_count; i++)
+        {
+            if (dirty_pages[i] == p_page)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+  public:
+    static const uint32_t NO_SPACE = FDS_ERR_NO_SPACE_IN_FLASH;     // write() result, when flash is full
+    static const uint8_t RECORD_HEADER_L = 12;     // bytes FDS writes in front of every record
+    static const uint8_t RECORD_DELETE_L = 4;     // bytes FDS writes to mark a record removed (record key set to 0)
+    static const uint16_t PAGE_WORDS = FDS_VIRTUAL_PAGE_SIZE - 2;     // words for records in one page (page tag excluded)
+
+    // Initializes FDS. Call after the SoftDevice is enabled. CPU sleeps until FDS is ready.
+    void init()
+    {
+        uint32_t err_code = fds_register(fdsEventHandler);
+        APP_ERROR_CHECK(err_code);
+        err_code = fds_init();
+        APP_ERROR_CHECK(err_code);
+        while (!fds_storage_state.init_done)
+        {
+            nrf_pwr_mgmt_run();
+        }
+    }
+
+
+    /*
+     * Starts writing a block.
+     * Params: p_words - block, must stay untouched until isBusy() returns false
+     *         p_length_words - block length [words]
+     *         p_record_id - output, id of the new record
+     * Returns: NRF_SUCCESS, NO_SPACE (remove a block and collect garbage first), or other FDS error
+     */
+    uint32_t write(const uint32_t *p_words, uint16_t p_length_words, uint32_t &p_record_id)
+    {
+        fds_record_t record;
+        record.file_id = FILE_ID;
+        record.key = RECORD_KEY;
+        record.data.p_data = p_words;
+        record.data.length_words = p_length_words;
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        startOperation();
+        uint32_t err_code = fds_record_write(&desc, &record);
+        if (err_code == NRF_SUCCESS)
+        {
+            p_record_id = desc.record_id;
+        }
+        else
+        {
+            cancelOperation();
+        }
+        return err_code;
+    }
+
+
+    /*
+     * Starts removing a block. Space is freed by collectGarbage().
+     * Params: p_record_id - id of the record
+     */
+    void remove(uint32_t p_record_id)
+    {
+        uint8_t page;
+        uint32_t bytes;
+        if (locate(p_record_id, page, bytes) && !isDirty(page) && dirty_count < FDS_VIRTUAL_PAGES)
+        {
+            dirty_pages[dirty_count++] = page;
+        }
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.record_id = p_record_id;
+        startOperation();
+        if (fds_record_delete(&desc) != NRF_SUCCESS)
+        {
+            cancelOperation();
+        }
+    }
+
+
+    /*
+     * Starts garbage collection: pages with removed blocks are erased, blocks still valid on them are copied first.
+     * Call when isBusy() returns false, so removals are done.
+     * Returns: bytes programmed by the copies (records and page tags)
+     */
+    uint32_t collectGarbage()
+    {
+        uint32_t copied_bytes = dirty_count * PAGE_TAG_L;
+        fds_find_token_t token;
+        memset(&token, 0, sizeof(token));
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        while (dirty_count > 0 && fds_record_find(FILE_ID, RECORD_KEY, &desc, &token) == NRF_SUCCESS)
+        {
+            uint8_t page;
+            uint32_t bytes;
+            if (locate(desc.record_id, page, bytes) && isDirty(page))
+            {
+                copied_bytes += bytes;
+            }
+        }
+
+        startOperation();
+        if (fds_gc() != NRF_SUCCESS)
+        {
+            cancelOperation();
+            return 0;
+        }
+        dirty_count = 0;
+        return copied_bytes;
+    }
+
+
+    // Returns true while a write, remove or garbage collection is running.
+    bool isBusy()
+    {
+        return fds_storage_state.pending > 0;
+    }
+
+
+    // Returns number of writes, that failed after they were started.
+    uint32_t getWriteErrors()
+    {
+        return fds_storage_state.write_errors;
+    }
+
+
+    /*
+     * Opens a block for reading. Garbage collection doesn't move an open block, close it with close().
+     * Params: p_record_id - id of the record
+     * Returns: pointer to the block in flash, NULL if there is no such block
+     */
+    const uint32_t *open(uint32_t p_record_id)
+    {
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.record_id = p_record_id;
+        fds_flash_record_t flash_record;
+        if (fds_record_open(&desc, &flash_record) != NRF_SUCCESS)
+        {
+            return NULL;
+        }
+        return (const uint32_t *)flash_record.p_data;
+    }
+
+
+    // Closes a block opened by open(). Params: p_record_id - id of the record
+    void close(uint32_t p_record_id)
+    {
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.record_id = p_record_id;
+        fds_record_close(&desc);
+    }
+
+
+    // Starts iterating over stored blocks with next().
+    void rewind()
+    {
+        memset(&find_token, 0, sizeof(find_token));
+    }
+
+
+    /*
+     * Finds the next stored block (in no particular order).
+     * Params: p_record_id - output, id of the record
+     * Returns: false if there are no more blocks
+     */
+    bool next(uint32_t &p_record_id)
+    {
+        fds_record_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        if (fds_record_find(FILE_ID, RECORD_KEY, &desc, &find_token) != NRF_SUCCESS)
+        {
+            return false;
+        }
+        p_record_id = desc.record_id;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef FLASH_HISTORY_H
+#define FLASH_HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "History_log.h"
+
+
+// Flash_history counters. Write amplification is flash_bytes / sample_bytes.
+struct Flash_history_stats
+{
+    uint32_t samples;     // records added
+    uint32_t dropped;     // records lost, because flash was still busy when a block had to be closed
+    uint32_t sample_bytes;     // records written to flash, as History_records
+    uint32_t encoded_bytes;     // blocks written to flash (block headers + delta encoded records)
+    uint32_t gc_bytes;     // bytes programmed by garbage collection (valid blocks copied off collected pages)
+    uint32_t flash_bytes;     // bytes programmed (blocks + storage record headers + removal marks + gc_bytes)
+    uint32_t blocks_written;
+    uint32_t blocks_removed;
+    uint32_t gc_runs;
+};
+
+
+
+/*
+ * Class for logging pressure and temperature history in flash, so it survives System OFF and resets.
+ *
+ * Records are delta encoded (zigzag varints, usually 2 bytes per record instead of 4) into a block in RAM. A full
+ * block is written to flash at once, while the next one is filled in the second RAM buffer. So flash is programmed
+ * once per block, not once per record. When MAX_BLOCKS are stored (or storage is full), the oldest blocks that fit
+ * in one storage page are removed together and garbage collected before the next block is written.
+ *
+ * Garbage collection copies blocks still valid on a collected page before it erases it, and those copies are flash
+ * writes too. Blocks fill pages in the order they are written, so removing a page's worth of the oldest blocks
+ * usually empties the oldest page and nothing is copied. Blocks flushed before they were full (flush()) shift
+ * the page boundaries, then some blocks are copied. Copied bytes are counted in stats (gc_bytes, flash_bytes).
+ * So between MAX_BLOCKS - (blocks per page) and MAX_BLOCKS blocks are kept.
+ *
+ * An index of stored blocks (sorted by sequence number) is kept in RAM and rebuilt by load(), so add() doesn't read
+ * flash and read() finds the block with a binary search. Sequence numbers are the same as in History_log.
+ *
+ * Template parameters:
+ * BLOCK_WORDS - block size [words], header included
+ * MAX_BLOCKS - number of blocks kept in flash
+ * STORAGE - block storage, Fds_storage on target (any class with the same methods, e.g. test/Sim_storage.h on host)
+ */
+template <uint16_t BLOCK_WORDS, uint8_t MAX_BLOCKS, class STORAGE>
+class Flash_history
+{
+    struct Block_header
+    {
+        uint32_t first_sequence;     // sequence number of the first record
+        uint16_t pressure;     // first record, not encoded
+        int16_t temperature;
+        uint16_t count;     // number of records
+        uint16_t used;     // payload bytes used by the delta encoded records
+    };
+
+    struct Block_entry
+    {
+        uint32_t first_sequence;
+        uint32_t record_id;     // storage record
+        uint16_t count;
+        uint16_t words;     // block length in storage [words]
+        const uint32_t *p_ram;     // RAM buffer while the block is being written, then NULL
+    };
+
+    static const uint16_t PAYLOAD_L = BLOCK_WORDS * 4 - sizeof(Block_header);
+    static const uint8_t MAX_DELTA_L = 6;     // pressure and temperature deltas fit in 17 bits, 3 varint bytes each
+    static_assert(sizeof(Block_header) == 12, "Block_header is stored in flash, it must not be padded");
+    static_assert(PAYLOAD_L >= MAX_DELTA_L && PAYLOAD_L < 0x10000, "BLOCK_WORDS out of range");
+
+    STORAGE &storage;
+    uint32_t buffers[2][BLOCK_WORDS];     // words, storage writes words
+    uint8_t filling = 0;     // buffer with the block being filled
+    bool flush_pending = false;     // the other buffer holds a closed block, not written yet
+    bool gc_pending = false;     // blocks were removed, garbage is collected when the removals are done
+    Block_entry index[MAX_BLOCKS];     // ring, oldest block first
+    uint8_t index_first = 0;
+    uint8_t index_count = 0;
+    uint32_t total = 0;     // sequence number of the next record
+    uint16_t last_pressure = 0;     // previous record, deltas are counted from it
+    int16_t last_temperature = 0;
+    Flash_history_stats stats;
+
+
+    Block_header *header(uint8_t p_buffer)
+    {
+        return (Block_header *)buffers[p_buffer];
+    }
+
+
+    Block_entry &entry(uint8_t p_position)
+    {
+        return index[(index_first + p_position) % MAX_BLOCKS];
+    }
+
+
+    /*
+     * Encodes a signed value as a zigzag varint (7 bits per byte, small values of both signs take 1 byte).
+     * Params: p_value - value to encode
+     *         p_out - output, 3 bytes at most
+     * Returns: number of bytes written
+     */
+    static uint8_t encode(int32_t p_value, uint8_t *p_out)
+    {
+        uint32_t zigzag = ((uint32_t)p_value << 1) ^ (uint32_t)(p_value >> 31);
+        uint8_t len = 0;
+        while (zigzag >= 0x80)
+        {
+            p_out[len++] = (uint8_t)(zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        p_out[len++] = (uint8_t)zigzag;
+        return len;
+    }
+
+
+    /*
+     * Decodes a zigzag varint written by encode().
+     * Params: p_data - encoded bytes
+     *         p_position - position of the varint, moved past it
+     * Returns: decoded value
+     */
+    static int32_t decode(const uint8_t *p_data, uint16_t &p_position)
+    {
+        uint32_t zigzag = 0;
+        uint8_t shift = 0;
+        uint8_t byte;
+        do
+        {
+            byte = p_data[p_position++];
+            zigzag |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    }
+
+
+    /*
+     * Closes the block being filled, it gets written by service(). Filling goes on in the other buffer.
+     * Returns: false if the other buffer isn't free yet (previous block still being written)
+     */
+    bool closeBlock()
+    {
+        if (flush_pending || storage.isBusy())
+        {
+            return false;
+        }
+        releaseRam();
+        flush_pending = true;
+        filling ^= 1;
+        header(filling)->count = 0;
+        service();
+        return true;
+    }
+
+
+    // Marks written blocks as readable from storage. Call when storage isn't busy.
+    void releaseRam()
+    {
+        for (uint8_t i = 0; i < index_count; i++)
+        {
+            entry(i).p_ram = NULL;
+        }
+    }
+
+
+    // Starts removing the oldest blocks, that fit in one storage page, so there is space for new ones (see the class doc).
+    void removeOldest()
+    {
+        uint32_t words = 0;     // storage taken by the removed blocks
+        while (index_count > 0)
+        {
+            const uint32_t block_words = entry(0).words + STORAGE::RECORD_HEADER_L / 4;
+            if (words > 0 && words + block_words > STORAGE::PAGE_WORDS)
+            {
+                break;
+            }
+            words += block_words;
+            remove(entry(0).record_id);
+            index_first = (index_first + 1) % MAX_BLOCKS;
+            index_count--;
+        }
+        gc_pending = true;
+    }
+
+
+    // Starts removing a block from storage. Params: p_record_id - storage record
+    void remove(uint32_t p_record_id)
+    {
+        storage.remove(p_record_id);
+        stats.blocks_removed++;
+        stats.flash_bytes += STORAGE::RECORD_DELETE_L;
+    }
+
+
+    // Starts garbage collection and counts the bytes it programs. Call when storage isn't busy.
+    void collectGarbage()
+    {
+        const uint32_t bytes = storage.collectGarbage();
+        stats.gc_bytes += bytes;
+        stats.flash_bytes += bytes;
+        stats.gc_runs++;
+        gc_pending = false;
+    }
+
+
+    /*
+     * Finds the first block, that holds records from a sequence number on (binary search).
+     * Params: p_sequence - sequence number
+     * Returns: position in the index, index_count if there is no such block
+     */
+    uint8_t findBlock(uint32_t p_sequence)
+    {
+        uint8_t low = 0;
+        uint8_t high = index_count;
+        while (low < high)
+        {
+            const uint8_t middle = (low + high) / 2;
+            if (entry(middle).first_sequence + entry(middle).count <= p_sequence)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+
+    /*
+     * Decodes records of one block, starting from p_sequence + p_count.
+     * Params: p_block - the block
+     *         p_sequence - sequence number of the first record read, moved forward if the read starts before the block
+     *         p_count - number of records read so far, increased
+     *         p_records - output
+     *         p_max - maximal number of records
+     * Returns: false if there are missing records before the block (the read has to end before the gap)
+     */
+    bool readBlock(const uint32_t *p_block, uint32_t &p_sequence, uint16_t &p_count, History_record *p_records, uint16_t p_max)
+    {
+        const Block_header *p_header = (const Block_header *)p_block;
+        const uint32_t end = p_header->first_sequence + p_header->count;
+        if (p_header->count == 0 || p_sequence + p_count >= end)
+        {
+            return true;
+        }
+        if (p_sequence + p_count < p_header->first_sequence)
+        {
+            if (p_count > 0)
+            {
+                return false;
+            }
+            p_sequence = p_header->first_sequence;
+        }
+
+        const uint8_t *payload = (const uint8_t *)p_block + sizeof(Block_header);
+        uint16_t position = 0;
+        int32_t pressure = p_header->pressure;
+        int32_t temperature = p_header->temperature;
+        for (uint32_t sequence = p_header->first_sequence; p_count < p_max; )
+        {
+            if (sequence == p_sequence + p_count)
+            {
+                p_records[p_count].pressure = (uint16_t)pressure;
+                p_records[p_count].temperature = (int16_t)temperature;
+                p_count++;
+            }
+            if (++sequence == end)
+            {
+                break;
+            }
+            pressure += decode(payload, position);
+            temperature += decode(payload, position);
+        }
+        return true;
+    }
+
+  public:
+
+    // Params: p_storage - initialized storage
+    Flash_history(STORAGE &p_storage) : storage(p_storage)
+    {
+        header(0)->count = 0;
+        header(1)->count = 0;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+
+    // Rebuilds the index from blocks in storage. Call once, before add(). Surplus oldest blocks are removed.
+    void load()
+    {
+        uint32_t record_id;
+        storage.rewind();
+        while (storage.next(record_id))
+        {
+            const uint32_t *p_block = storage.open(record_id);
+            if (p_block == NULL)
+            {
+                continue;
+            }
+            Block_entry new_entry = {0, record_id, 0, 0, NULL};
+            new_entry.first_sequence = ((const Block_header *)p_block)->first_sequence;
+            new_entry.count = ((const Block_header *)p_block)->count;
+            new_entry.words = (sizeof(Block_header) + ((const Block_header *)p_block)->used + 3) / 4;
+            storage.close(record_id);
+
+            if (index_count == MAX_BLOCKS)
+            {
+                gc_pending = true;     // collected by service()
+                if (new_entry.first_sequence < index[0].first_sequence)
+                {
+                    remove(record_id);
+                    continue;
+                }
+                remove(index[0].record_id);
+                memmove(&index[0], &index[1], (MAX_BLOCKS - 1) * sizeof(Block_entry));
+                index_count--;
+            }
+            uint8_t i = index_count++;     // insertion sort, index_first is 0 here
+            for (; i > 0 && index[i - 1].first_sequence > new_entry.first_sequence; i--)
+            {
+                index[i] = index[i - 1];
+            }
+            index[i] = new_entry;
+        }
+        if (index_count > 0)
+        {
+            total = index[index_count - 1].first_sequence + index[index_count - 1].count;
+        }
+    }
+
+
+    /*
+     * Adds a record.
+     * Params: p_pressure_kPa - pressure [kPa]
+     *         p_temperature - temperature [1/100 *C]
+     */
+    void add(uint16_t p_pressure_kPa, int16_t p_temperature)
+    {
+        stats.samples++;
+        Block_header *p_header = header(filling);
+        if (p_header->count > 0)
+        {
+            uint8_t delta[MAX_DELTA_L];
+            uint8_t len = encode((int32_t)p_pressure_kPa - last_pressure, delta);
+            len += encode((int32_t)p_temperature - last_temperature, delta + len);
+            if (p_header->used + len <= PAYLOAD_L)
+            {
+                memcpy((uint8_t *)p_header + sizeof(Block_header) + p_header->used, delta, len);
+                p_header->used += len;
+                p_header->count++;
+                last_pressure = p_pressure_kPa;
+                last_temperature = p_temperature;
+                total++;
+                return;
+            }
+            if (!closeBlock())
+            {
+                stats.dropped++;
+                return;
+            }
+            p_header = header(filling);
+        }
+        p_header->first_sequence = total;     // new block
+        p_header->pressure = p_pressure_kPa;
+        p_header->temperature = p_temperature;
+        p_header->count = 1;
+        p_header->used = 0;
+        last_pressure = p_pressure_kPa;
+        last_temperature = p_temperature;
+        total++;
+    }
+
+
+    // Writes a closed block, when storage is free. Call from the main loop.
+    void service()
+    {
+        if (storage.isBusy())
+        {
+            return;
+        }
+        releaseRam();
+        if (gc_pending)
+        {
+            collectGarbage();     // removals are done, the block is written on a later call
+            return;
+        }
+        if (!flush_pending)
+        {
+            return;
+        }
+        if (index_count == MAX_BLOCKS)
+        {
+            removeOldest();     // written on a later call, after garbage collection
+            return;
+        }
+
+        const uint32_t *p_block = buffers[filling ^ 1];
+        const Block_header *p_header = (const Block_header *)p_block;
+        const uint16_t words = (sizeof(Block_header) + p_header->used + 3) / 4;
+        uint32_t record_id;
+        const uint32_t err_code = storage.write(p_block, words, record_id);
+        if (err_code == STORAGE::NO_SPACE)
+        {
+            removeOldest();
+            return;
+        }
+        if (err_code != 0)     // storage queue full, tried again on the next call
+        {
+            return;
+        }
+        Block_entry &new_entry = index[(index_first + index_count) % MAX_BLOCKS];
+        new_entry.first_sequence = p_header->first_sequence;
+        new_entry.record_id = record_id;
+        new_entry.count = p_header->count;
+        new_entry.words = words;
+        new_entry.p_ram = p_block;
+        index_count++;
+        flush_pending = false;
+        stats.blocks_written++;
+        stats.sample_bytes += p_header->count * sizeof(History_record);
+        stats.encoded_bytes += sizeof(Block_header) + p_header->used;
+        stats.flash_bytes += words * 4 + STORAGE::RECORD_HEADER_L;
+    }
+
+
+    /*
+     * Writes everything from RAM to flash, also a block that isn't full. Call before RAM is lost (System OFF),
+     * until it returns true.
+     * Returns: true if all records are in flash
+     */
+    bool flush()
+    {
+        service();
+        if (header(filling)->count > 0)
+        {
+            closeBlock();
+        }
+        return !flush_pending && !gc_pending && header(filling)->count == 0 && !storage.isBusy();
+    }
+
+
+    /*
+     * Reads consecutive records (from flash blocks, then from RAM).
+     * Params: p_sequence - sequence number of the first record to read. If it is older than the oldest record kept,
+     *                      it is moved to the oldest one.
+     *         p_records - output
+     *         p_max - maximal number of records to read
+     * Returns: number of records read, 0 if there are no records from p_sequence on
+     */
+    uint16_t read(uint32_t &p_sequence, History_record *p_records, uint16_t p_max)
+    {
+        uint16_t count = 0;
+        for (uint8_t i = findBlock(p_sequence); i < index_count && count < p_max; i++)
+        {
+            const Block_entry &block_entry = entry(i);
+            const uint32_t *p_block = block_entry.p_ram;
+            if (p_block == NULL)
+            {
+                p_block = storage.open(block_entry.record_id);
+                if (p_block == NULL)     // write failed, records missing
+                {
+                    continue;
+                }
+            }
+            const bool contiguous = readBlock(p_block, p_sequence, count, p_records, p_max);
+            if (block_entry.p_ram == NULL)
+            {
+                storage.close(block_entry.record_id);
+            }
+            if (!contiguous)
+            {
+                return count;
+            }
+        }
+        if (flush_pending && count < p_max && !readBlock(buffers[filling ^ 1], p_sequence, count, p_records, p_max))
+        {
+            return count;
+        }
+        if (count < p_max)
+        {
+            readBlock(buffers[filling], p_sequence, count, p_records, p_max);
+        }
+        return count;
+    }
+
+
+    // Returns counters since power on.
+    const Flash_history_stats &getStats()
+    {
+        return stats;
+    }
+
+
+    // Returns write amplification (bytes programmed per byte of History_records) [1/1000].
+    uint32_t getWriteAmplification()
+    {
+        return stats.sample_bytes ? (uint64_t)stats.flash_bytes * 1000 / stats.sample_bytes : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <stdint.h>
+
+
+// One history record, sent as is (little endian) by History_service.
+struct History_record
+{
+    uint16_t pressure;     // [kPa]
+    int16_t temperature;     // [1/100 *C]
+};
+
+static_assert(sizeof(History_record) == 4, "History_record is sent over the air, it must not be padded");
+
+
+
+/*
+ * Class for logging pressure and temperature history in a RAM ring. When the ring is full, the oldest record is overwritten.
+ * Every record gets a sequence number (number of records logged before it), so a download can be resumed where it stopped.
+ *
+ * Template parameters:
+ * CAPACITY - number of records kept
+ */
+template <uint16_t CAPACITY>
+class History_log
+{
+    History_record ring[CAPACITY];
+    uint32_t total = 0;     // number of records ever logged (sequence number of the next record)
+
+  public:
+
+    /*
+     * Adds a record.
+     * Params: p_pressure_kPa - pressure [kPa]
+     *         p_temperature - temperature [1/100 *C]
+     */
+    void add(uint16_t p_pressure_kPa, int16_t p_temperature)
+    {
+        History_record &record = ring[total % CAPACITY];
+        record.pressure = p_pressure_kPa;
+        record.temperature = p_temperature;
+        total++;
+    }
+
+
+    /*
+     * Reads consecutive records.
+     * Params: p_sequence - sequence number of the first record to read. If it is older than the oldest record kept,
+     *                      it is moved to the oldest one.
+     *         p_records - output
+     *         p_max - maximal number of records to read
+     * Returns: number of records read, 0 if there are no records from p_sequence on
+     */
+    uint16_t read(uint32_t &p_sequence, History_record *p_records, uint16_t p_max)
+    {
+        const uint32_t oldest = (total > CAPACITY) ? total - CAPACITY : 0;
+        if (p_sequence < oldest)
+        {
+            p_sequence = oldest;
+        }
+        uint16_t count = 0;
+        for (uint32_t sequence = p_sequence; sequence < total && count < p_max; sequence++)
+        {
+            p_records[count++] = ring[sequence % CAPACITY];
+        }
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,315 @@
+#include "History_service.h"
+#include <string.h>
+
+
+// 128-bit base UUID of the service (little endian), the 16-bit UUIDs below go to bytes 12 - 13
+static const ble_uuid128_t HISTORY_UUID_BASE = {{0x3E, 0x1C, 0x5A, 0x77, 0x0B, 0x92, 0x4D, 0x61,
+                                                 0x8F, 0x27, 0xC4, 0x10, 0x00, 0x00, 0x7A, 0xE2}};
+static const uint16_t HISTORY_SERVICE_UUID = 0x1500;
+static const uint16_t HISTORY_DATA_UUID = 0x1501;
+static const uint16_t HISTORY_CONTROL_UUID = 0x1502;
+
+#define HISTORY_SERVICE_BLE_OBSERVER_PRIO 2
+
+static History_service *p_history_service = NULL;     // instance, that gets BLE events
+
+NRF_BLE_GATT_DEF(m_gatt);
+NRF_SDH_BLE_OBSERVER(m_history_service_obs, HISTORY_SERVICE_BLE_OBSERVER_PRIO, History_service::bleEventHandler, NULL);
+
+
+
+/*
+ * nrf_ble_gatt event handler. Notifications grow with negotiated ATT MTU.
+ */
+static void gattEventHandler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *p_evt)
+{
+    if (p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED && p_history_service != NULL)
+    {
+        p_history_service->setPayloadLength(p_evt->params.att_mtu_effective);
+    }
+}
+
+
+
+/*
+ * Function for initializing the service. Call after the SoftDevice is enabled.
+ * Params: p_reader - function reading history records
+ */
+void History_service::init(history_reader_t p_reader)
+{
+    reader = p_reader;
+    p_history_service = this;
+
+    uint32_t err_code;
+    err_code = nrf_ble_gatt_init(&m_gatt, gattEventHandler);     // ATT MTU exchange and data length update are done by nrf_ble_gatt
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_ble_gatt_att_mtu_periph_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, NRF_SDH_BLE_GAP_DATA_LENGTH);
+    APP_ERROR_CHECK(err_code);
+
+    ble_gap_conn_params_t conn_params;     // preferred connection parameters, so the central knows them at once
+    conn_params.min_conn_interval = cfg::HISTORY_MIN_CONN_INTERVAL;
+    conn_params.max_conn_interval = cfg::HISTORY_MAX_CONN_INTERVAL;
+    conn_params.slave_latency = 0;
+    conn_params.conn_sup_timeout = cfg::HISTORY_CONN_SUP_TIMEOUT;
+    err_code = sd_ble_gap_ppcp_set(&conn_params);
+    APP_ERROR_CHECK(err_code);
+
+    uint8_t uuid_type;
+    err_code = sd_ble_uuid_vs_add(&HISTORY_UUID_BASE, &uuid_type);
+    APP_ERROR_CHECK(err_code);
+    ble_uuid_t service_uuid = {HISTORY_SERVICE_UUID, uuid_type};
+    err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &service_handle);
+    APP_ERROR_CHECK(err_code);
+    addCharacteristics(uuid_type);
+}
+
+
+
+/*
+ * Function for adding Data and Control characteristics.
+ * Params: p_uuid_type - vendor specific UUID type of the service
+ */
+void History_service::addCharacteristics(uint8_t p_uuid_type)
+{
+    uint32_t err_code;
+    ble_add_char_params_t char_params;
+
+    memset(&char_params, 0, sizeof(char_params));
+    char_params.uuid = HISTORY_DATA_UUID;
+    char_params.uuid_type = p_uuid_type;
+    char_params.max_len = NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3;
+    char_params.init_len = 0;
+    char_params.is_var_len = true;
+    char_params.char_props.notify = 1;
+    char_params.read_access = SEC_OPEN;
+    char_params.cccd_write_access = SEC_OPEN;
+    err_code = characteristic_add(service_handle, &char_params, &data_handles);
+    APP_ERROR_CHECK(err_code);
+
+    memset(&char_params, 0, sizeof(char_params));
+    char_params.uuid = HISTORY_CONTROL_UUID;
+    char_params.uuid_type = p_uuid_type;
+    char_params.max_len = SEQUENCE_L;
+    char_params.init_len = SEQUENCE_L;
+    char_params.char_props.write = 1;
+    char_params.write_access = SEC_OPEN;
+    err_code = characteristic_add(service_handle, &char_params, &control_handles);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+
+/*
+ * Function for setting notification length after ATT MTU exchange.
+ * Params: p_att_mtu - effective ATT MTU
+ */
+void History_service::setPayloadLength(uint16_t p_att_mtu)
+{
+    payload_len = p_att_mtu - 3;     // ATT notification header
+}
+
+
+
+/*
+ * Function for requesting a download (BLE event context).
+ * Params: p_sequence - sequence number to start from
+ */
+void History_service::requestStart(uint32_t p_sequence)
+{
+    start_sequence = p_sequence;
+    stop_requested = false;
+    start_requested = true;
+    scheduleSend();
+}
+
+
+
+// Function for stopping the download (BLE event context).
+void History_service::requestStop()
+{
+    start_requested = false;
+    stop_requested = true;
+}
+
+
+
+// Function for running sendRecords() in main() context. One event in the queue is enough, it sends all it can.
+void History_service::scheduleSend()
+{
+    if (!send_pending)
+    {
+        send_pending = true;
+        uint32_t err_code = app_sched_event_put(NULL, 0, sendEvent);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+
+
+// app_scheduler event handler, p_history_service is the instance.
+void History_service::sendEvent(void *p_event_data, uint16_t p_event_size)
+{
+    p_history_service->send_pending = false;
+    p_history_service->sendRecords();
+}
+
+
+
+/*
+ * Function for queuing notifications with records, until the SoftDevice queue is full or the download ends.
+ * Runs in main() context, so reader() doesn't race with history being written.
+ */
+void History_service::sendRecords()
+{
+    CRITICAL_REGION_ENTER();
+    if (stop_requested)
+    {
+        streaming = false;
+        stop_requested = false;
+    }
+    if (start_requested)
+    {
+        next_sequence = start_sequence;
+        streaming = true;
+        start_requested = false;
+    }
+    CRITICAL_REGION_EXIT();
+
+    while (streaming)
+    {
+        uint32_t buffer[(NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3 + 3) / 4];     // word aligned, so records can be read into it
+        uint8_t *data = (uint8_t *)buffer;
+        uint32_t sequence = next_sequence;
+        const uint16_t max_records = (payload_len - SEQUENCE_L) / sizeof(History_record);
+        const uint16_t count = reader(sequence, (History_record *)(data + SEQUENCE_L), max_records);
+        memcpy(data, &sequence, SEQUENCE_L);     // little endian, like the records
+
+        uint16_t len = SEQUENCE_L + count * sizeof(History_record);
+        ble_gatts_hvx_params_t hvx_params;
+        memset(&hvx_params, 0, sizeof(hvx_params));
+        hvx_params.handle = data_handles.value_handle;
+        hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+        hvx_params.p_len = &len;
+        hvx_params.p_data = data;
+        uint32_t err_code = sd_ble_gatts_hvx(conn_handle, &hvx_params);
+        if (err_code == NRF_ERROR_RESOURCES)     // queue full, continued on BLE_GATTS_EVT_HVN_TX_COMPLETE
+        {
+            return;
+        }
+        if (err_code != NRF_SUCCESS)     // disconnected or notifications disabled in the meantime
+        {
+            streaming = false;
+            return;
+        }
+        next_sequence = sequence + count;
+        if (count == 0)     // end of download was sent
+        {
+            streaming = false;
+        }
+    }
+}
+
+
+
+/*
+ * SoftDevice BLE event handler (observer).
+ */
+void History_service::bleEventHandler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+    if (p_history_service != NULL)
+    {
+        p_history_service->onBleEvent(p_ble_evt);
+    }
+}
+
+
+
+/*
+ * Function for handling BLE events: connection setup for fast transfer, download start and flow control.
+ */
+void History_service::onBleEvent(ble_evt_t const *p_ble_evt)
+{
+    uint32_t err_code;
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+        {
+            conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            payload_len = BLE_GATT_ATT_MTU_DEFAULT - 3;
+            const ble_gap_phys_t phys = {BLE_GAP_PHY_2MBPS, BLE_GAP_PHY_2MBPS};
+            err_code = sd_ble_gap_phy_update(conn_handle, &phys);
+            if (err_code != NRF_ERROR_BUSY)     // central started its own PHY update, it goes on with that one
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            ble_gap_conn_params_t conn_params = p_ble_evt->evt.gap_evt.params.connected.conn_params;
+            conn_params.min_conn_interval = cfg::HISTORY_MIN_CONN_INTERVAL;
+            conn_params.max_conn_interval = cfg::HISTORY_MAX_CONN_INTERVAL;
+            conn_params.slave_latency = 0;
+            conn_params.conn_sup_timeout = cfg::HISTORY_CONN_SUP_TIMEOUT;
+            sd_ble_gap_conn_param_update(conn_handle, &conn_params);     // central may refuse, the download works anyway
+            break;
+        }
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            conn_handle = BLE_CONN_HANDLE_INVALID;
+            requestStop();
+            break;
+
+        case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
+        {
+            const ble_gap_phys_t phys = {BLE_GAP_PHY_AUTO, BLE_GAP_PHY_AUTO};
+            err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
+            APP_ERROR_CHECK(err_code);
+            break;
+        }
+
+        case BLE_GAP_EVT_SEC_PARAMS_REQUEST:     // no pairing, history isn't secret
+            err_code = sd_ble_gap_sec_params_reply(conn_handle, BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP, NULL, NULL);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_GATTS_EVT_SYS_ATTR_MISSING:     // no bonding, so no stored CCCDs
+            err_code = sd_ble_gatts_sys_attr_set(conn_handle, NULL, 0, 0);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+        {
+            const ble_gatts_evt_write_t *p_write = &p_ble_evt->evt.gatts_evt.params.write;
+            if (p_write->handle == data_handles.cccd_handle && p_write->len == 2)
+            {
+                if (ble_srv_is_notification_enabled(p_write->data))
+                {
+                    requestStart(0);     // from the oldest record
+                }
+                else
+                {
+                    requestStop();
+                }
+            }
+            else if (p_write->handle == control_handles.value_handle && p_write->len == SEQUENCE_L)
+            {
+                uint32_t sequence;
+                memcpy(&sequence, p_write->data, SEQUENCE_L);
+                requestStart(sequence);
+            }
+            break;
+        }
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            scheduleSend();
+            break;
+
+        case BLE_GATTC_EVT_TIMEOUT:
+        case BLE_GATTS_EVT_TIMEOUT:
+            err_code = sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef HISTORY_SERVICE_H
+#define HISTORY_SERVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "History_log.h"
+#include "my_config.h"
+extern "C" {
+#include "ble.h"
+#include "ble_srv_common.h"
+#include "nrf_sdh_ble.h"
+#include "nrf_ble_gatt.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
+}
+
+
+/*
+ * Reads history records for download.
+ * Params: p_sequence - sequence number of the first record, moved to the oldest record kept if older
+ *         p_records - output
+ *         p_max - maximal number of records
+ * Returns: number of records read, 0 - no more records
+ */
+typedef uint16_t (*history_reader_t)(uint32_t &p_sequence, History_record *p_records, uint16_t p_max);
+
+
+
+/*
+ * GATT service for downloading logged history (CONNECTABLE_HISTORY in my_config.h).
+ *
+ * Characteristics:
+ * Data (notify) - every notification is: uint32 sequence number of the first record, then as many History_records
+ *                 as fit in (ATT MTU - 3) bytes, all little endian. A notification without records ends the download.
+ * Control (write) - uint32 sequence number to (re)start the download from. Enabling Data notifications starts
+ *                   the download from the oldest record.
+ *
+ * Connection is set up for a short, high throughput transfer: maximal ATT MTU and data length (nrf_ble_gatt), 2M PHY
+ * and short connection interval. Notifications are queued until the SoftDevice queue is full, and refilled
+ * on every BLE_GATTS_EVT_HVN_TX_COMPLETE, so every connection event is filled up.
+ *
+ * BLE events come in the SoftDevice interrupt, while history is written in main() context. So the events only record
+ * the request and put an event to app_scheduler, records are read and queued by app_sched_execute() in main().
+ * Call APP_SCHED_INIT() before init().
+ */
+class History_service
+{
+    static const uint8_t SEQUENCE_L = 4;     // sequence number at the beginning of every notification
+
+    history_reader_t reader = NULL;
+    uint16_t service_handle;
+    ble_gatts_char_handles_t data_handles;
+    ble_gatts_char_handles_t control_handles;
+    volatile uint16_t conn_handle = BLE_CONN_HANDLE_INVALID;
+    uint16_t payload_len = BLE_GATT_ATT_MTU_DEFAULT - 3;     // notification length, grows after ATT MTU exchange
+    uint32_t next_sequence = 0;     // main() context only
+    bool streaming = false;     // main() context only
+    // requests from BLE events, taken over by sendRecords()
+    volatile bool start_requested = false;
+    volatile bool stop_requested = false;
+    volatile uint32_t start_sequence = 0;
+    volatile bool send_pending = false;     // sendEvent() is in app_scheduler queue
+
+    void addCharacteristics(uint8_t p_uuid_type);
+    void requestStart(uint32_t p_sequence);
+    void requestStop();
+    void scheduleSend();
+    void sendRecords();
+    void onBleEvent(ble_evt_t const *p_ble_evt);
+    static void sendEvent(void *p_event_data, uint16_t p_event_size);
+
+  public:
+    void init(history_reader_t p_reader);
+    void setPayloadLength(uint16_t p_att_mtu);
+    static void bleEventHandler(ble_evt_t const *p_ble_evt, void *p_context);
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef LEAK_DETECTOR_H
+#define LEAK_DETECTOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "my_utility.h"
+
+
+/*
+ * Class for detecting slow leaks. Pressure samples (normalized to 20*C, so cooling down after a ride doesn't look like a leak)
+ * are kept in a ring of WINDOW samples, SAMPLE_INTERVAL_S seconds apart. Pressure change rate is the least squares slope
+ * over the ring. Sums needed for the slope are updated incrementally, so adding a sample is O(1) regardless of WINDOW.
+ * The reported rate follows the slope only when it moves by RATE_DEADBAND or more (or the leak flag flips), so the slope
+ * jittering by a few LSBs from sample to sample doesn't update advertising every SAMPLE_INTERVAL_S.
+ *
+ * Template parameters:
+ * WINDOW - number of samples in the ring (slope is estimated over WINDOW * SAMPLE_INTERVAL_S seconds)
+ * SAMPLE_INTERVAL_S - time between samples [s]
+ * LEAK_RATE_THRESHOLD - pressure loss rate, that is reported as a leak [0.1kPa/h], positive
+ */
+template <uint8_t WINDOW, uint16_t SAMPLE_INTERVAL_S, int16_t LEAK_RATE_THRESHOLD>
+class Leak_detector
+{
+    static const int32_t ATMOSPHERIC_DKPA = 1013;     // sensor measures gauge pressure
+    static const int32_t REFERENCE_TEMP = 29315;     // 20*C in 1/100 K
+    static const int32_t KELVIN_OFFSET = 27315;     // 0*C in 1/100 K
+    static const int16_t RATE_DEADBAND = (LEAK_RATE_THRESHOLD / 2 > 0) ? LEAK_RATE_THRESHOLD / 2 : 1;     // [0.1kPa/h]
+
+    int32_t ring[WINDOW];     // normalized pressure [0.1kPa]
+    uint8_t oldest = 0;     // index of the oldest sample (next to be overwritten, once the ring is full)
+    uint8_t count = 0;
+    int32_t sum_y = 0;     // sum of samples
+    int32_t sum_xy = 0;     // sum of samples weighted by their position in the window (0 - oldest)
+    int16_t rate = 0;     // last reported rate [0.1kPa/h]
+    bool leaking = false;
+
+  public:
+
+    /*
+     * Adds a pressure sample. Call every SAMPLE_INTERVAL_S seconds.
+     * Params: p_pressure_kPa - filtered pressure [kPa]
+     *         p_temperature - filtered temperature [1/100 *C]
+     * Returns: true if leak flag changed or leak rate moved by RATE_DEADBAND or more (advertising should be updated)
+     */
+    bool addSample(uint16_t p_pressure_kPa, int16_t p_temperature)
+    {
+        // ideal gas: absolute pressure is proportional to absolute temperature
+        int32_t normalized = (int32_t)(((int64_t)p_pressure_kPa * 10 + ATMOSPHERIC_DKPA) * REFERENCE_TEMP
+                                       / (p_temperature + KELVIN_OFFSET)) - ATMOSPHERIC_DKPA;
+
+        if (count < WINDOW)
+        {
+            ring[count] = normalized;
+            sum_xy += (int32_t)count * normalized;
+            sum_y += normalized;
+            count++;
+        }
+        else
+        {
+            // every sample moves one position back, the oldest drops out, the new one is the last
+            int32_t dropped = ring[oldest];
+            sum_xy += (WINDOW - 1) * normalized - (sum_y - dropped);
+            sum_y += normalized - dropped;
+            ring[oldest] = normalized;
+            oldest = (oldest + 1) % WINDOW;
+        }
+
+        if (count < WINDOW)     // not enough history to tell
+        {
+            return false;
+        }
+
+        const int16_t slope = (int16_t)constrain(getSlopePerHour(), (int64_t)INT16_MIN, (int64_t)INT16_MAX);
+        const bool slope_leaking = (slope < -LEAK_RATE_THRESHOLD);
+        if (slope_leaking == leaking && abs((int32_t)slope - rate) < RATE_DEADBAND)
+        {
+            return false;
+        }
+        rate = slope;
+        leaking = slope_leaking;
+        return true;
+    }
+
+
+    // Returns true if pressure loss rate exceeds LEAK_RATE_THRESHOLD.
+    bool isLeaking()
+    {
+        return leaking;
+    }
+
+
+    // Returns last reported pressure change rate [0.1kPa/h], negative when pressure drops. 0 until the ring is full.
+    int16_t getRate()
+    {
+        return rate;
+    }
+
+
+  private:
+
+    // Returns least squares slope of the ring [0.1kPa/h]. x is the position in the window (0 - oldest).
+    int64_t getSlopePerHour()
+    {
+        const int64_t n = count;
+        const int64_t sum_x = n * (n - 1) / 2;
+        const int64_t sum_xx = n * (n - 1) * (2 * n - 1) / 6;
+        return (n * sum_xy - sum_x * sum_y) * 3600 / ((n * sum_xx - sum_x * sum_x) * SAMPLE_INTERVAL_S);
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef OVERSAMPLE_CONTROLLER_H
+#define OVERSAMPLE_CONTROLLER_H
+
+#include <stdint.h>
+
+
+/*
+ * Class for choosing SAADC oversampling (or burst length) for pressure readings at runtime. Conversion (and bridge on) 
+ * time scales linearly with the number of averaged samples, so the smallest setting, that still resolves pressure 
+ * sensitivity, is used. Settings are log2 of averaged samples: SAADC OVERSAMPLE register value, or burst length 
+ * for ADC::setPressureBurst().
+ *
+ * Noise is estimated from differences between consecutive readings (E[d^2] = 2 * variance), so slow pressure changes
+ * don't count as noise. Averaging 2^k samples divides variance by 2^k, so the variance measured at the current setting
+ * predicts the variance at any other setting. Setting is raised as soon as a window is too noisy (for example rough road)
+ * and lowered one step at a time, only after LOWER_AFTER quiet windows in a row.
+ *
+ * Template parameters:
+ * WINDOW - number of readings in one noise estimation window
+ * MIN_OVERSAMPLE, MAX_OVERSAMPLE - allowed range of settings (log2 of averaged samples)
+ */
+template <uint8_t WINDOW, uint8_t MIN_OVERSAMPLE, uint8_t MAX_OVERSAMPLE>
+class Oversample_controller
+{
+    static const uint8_t LOWER_AFTER = 3;
+
+    uint32_t target_variance_q8;     // maximal allowed variance of a reading in [raw^2 / 256]
+    uint8_t oversample;
+    uint16_t prev_raw = 0;
+    bool has_prev = false;
+    uint32_t diff_sq_sum = 0;
+    uint8_t count = 0;
+    uint8_t quiet_windows = 0;
+    uint32_t last_variance_q8 = 0;
+
+  public:
+
+    /*
+     * Constructor.
+     * Params: p_target_variance_q8 - maximal allowed variance of a reading in [raw^2 / 256]
+     *         p_initial_oversample - oversampling used before the first estimate
+     */
+    Oversample_controller(uint32_t p_target_variance_q8, uint8_t p_initial_oversample)
+    {
+        target_variance_q8 = p_target_variance_q8;
+        oversample = p_initial_oversample;
+    }
+
+
+    /*
+     * Call with every pressure reading taken with the current setting.
+     * Params: p_raw - raw pressure reading
+     * Returns: setting to be used for the next reading (log2 of averaged samples)
+     */
+    uint8_t update(uint16_t p_raw)
+    {
+        if (has_prev)
+        {
+            int32_t diff = (int32_t)p_raw - (int32_t)prev_raw;
+            diff_sq_sum += (uint32_t)(diff * diff);
+            count++;
+        }
+        prev_raw = p_raw;
+        has_prev = true;
+
+        if (count < WINDOW)
+        {
+            return oversample;
+        }
+
+        last_variance_q8 = (diff_sq_sum << 8) / (2 * count);
+        diff_sq_sum = 0;
+        count = 0;
+
+        // find the smallest setting, for which predicted variance (last_variance * 2^oversample / 2^k) fits the target
+        uint8_t needed = MIN_OVERSAMPLE;
+        while (needed < MAX_OVERSAMPLE && ((uint64_t)last_variance_q8 << oversample) > ((uint64_t)target_variance_q8 << needed))
+        {
+            needed++;
+        }
+
+        if (needed > oversample)     // noisy - raise immediately
+        {
+            oversample = needed;
+            quiet_windows = 0;
+            has_prev = false;     // readings with different settings can't be compared
+        }
+        else if (needed < oversample)     // quiet - lower one step, but only if it lasts
+        {
+            quiet_windows++;
+            if (quiet_windows >= LOWER_AFTER)
+            {
+                oversample--;
+                quiet_windows = 0;
+                has_prev = false;
+            }
+        }
+        else
+        {
+            quiet_windows = 0;
+        }
+        return oversample;
+    }
+
+
+    // Returns currently chosen setting (log2 of averaged samples). Useful for diagnostics.
+    uint8_t getOversample()
+    {
+        return oversample;
+    }
+
+
+    // Returns variance of a reading [raw^2 / 256] measured in the last full window. Useful for diagnostics.
+    uint32_t getVariance()
+    {
+        return last_variance_q8;
+    }
+};
+
+#endif
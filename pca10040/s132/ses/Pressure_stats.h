@@ -0,0 +1,65 @@
+#ifndef PRESSURE_STATS_H
+#define PRESSURE_STATS_H
+
+#include <stdint.h>
+
+
+/*
+ * Class for collecting pressure statistics since wake up (RAM is cleared by System OFF, so it starts over every ride).
+ */
+class Pressure_stats
+{
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum = 0;     // can't overflow: count wraps first, after 136 years at 1 reading/s
+    uint32_t count = 0;
+
+  public:
+
+    // Constructor. Params: p_pressure_kPa - first pressure reading
+    Pressure_stats(uint16_t p_pressure_kPa)
+    {
+        min = p_pressure_kPa;
+        max = p_pressure_kPa;
+        add(p_pressure_kPa);
+    }
+
+
+    // Adds a reading. Params: p_pressure_kPa - pressure reading [kPa]
+    void add(uint16_t p_pressure_kPa)
+    {
+        if (p_pressure_kPa < min)
+        {
+            min = p_pressure_kPa;
+        }
+        if (p_pressure_kPa > max)
+        {
+            max = p_pressure_kPa;
+        }
+        sum += p_pressure_kPa;
+        count++;
+    }
+
+
+    // Returns minimal pressure since wake up [kPa].
+    uint16_t getMin()
+    {
+        return min;
+    }
+
+
+    // Returns maximal pressure since wake up [kPa].
+    uint16_t getMax()
+    {
+        return max;
+    }
+
+
+    // Returns average pressure since wake up [kPa].
+    uint16_t getAverage()
+    {
+        return (uint16_t)((sum + count / 2) / count);     // 64 bit division, but only once per advertising update
+    }
+};
+
+#endif
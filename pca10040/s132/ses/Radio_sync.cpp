@@ -0,0 +1,50 @@
+#include "Radio_sync.h"
+
+
+Radio_sync_state radio_sync_state = {false, 0, NULL};
+
+
+
+// Returns true if the radio is taken as active at p_counter (app_timer counter). Call with interrupts masked.
+static bool radioActiveAt(uint32_t p_counter)
+{
+    return radio_sync_state.radio_active
+           && app_timer_cnt_diff_compute(p_counter, radio_sync_state.active_since) < RADIO_MAX_ACTIVE_TICKS;
+}
+
+
+
+/*
+ * Radio notification interrupt. SoftDevice signals it (on SWI1) NOTIFICATION_DISTANCE before every radio event
+ * and again when the event ends, and both look the same. A notification is taken as the end of an event only if
+ * an event started less than RADIO_MAX_ACTIVE_TICKS ago, so a missed notification can't invert the state for
+ * the rest of the session, it is right again with the next radio event.
+ */
+extern "C" void SWI1_IRQHandler(void)
+{
+    const uint32_t counter = app_timer_cnt_get();
+    if (radioActiveAt(counter))
+    {
+        radio_sync_state.radio_active = false;
+        if (radio_sync_state.idle_handler != NULL)
+        {
+            radio_sync_state.idle_handler();
+        }
+    }
+    else
+    {
+        radio_sync_state.active_since = counter;
+        radio_sync_state.radio_active = true;
+    }
+}
+
+
+
+bool Radio_sync::isRadioIdle()
+{
+    bool active;
+    CRITICAL_REGION_ENTER();
+    active = radioActiveAt(app_timer_cnt_get());
+    CRITICAL_REGION_EXIT();
+    return !active;
+}
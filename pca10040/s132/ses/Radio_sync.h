@@ -0,0 +1,66 @@
+#ifndef RADIO_SYNC_H
+#define RADIO_SYNC_H
+
+#include <stdint.h>
+extern "C" {
+#include "nrf_soc.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+}
+
+
+typedef void (*radio_idle_handler_t)(void);
+
+// the longest a radio event can be active: NOTIFICATION_DISTANCE + GAP event length (NRF_SDH_BLE_GAP_EVENT_LENGTH 7.5 ms) + margin
+static const uint32_t RADIO_MAX_ACTIVE_TICKS = APP_TIMER_TICKS(10);
+
+// state shared with SWI1_IRQHandler()
+struct Radio_sync_state
+{
+    volatile bool radio_active;
+    volatile uint32_t active_since;     // app_timer counter at the last active notification
+    radio_idle_handler_t idle_handler;
+};
+
+extern Radio_sync_state radio_sync_state;     // defined in Radio_sync.cpp, together with SWI1_IRQHandler()
+
+extern "C" void SWI1_IRQHandler(void);
+
+
+
+/*
+ * Class for synchronizing readings with radio activity. Readings, that fall on a radio event, are deferred until
+ * it ends (radio notification), so the conversion (and DCDC off window) doesn't overlap radio activity.
+ */
+class Radio_sync
+{
+  public:
+
+    /*
+     * Enables radio notifications. Call after the SoftDevice is enabled.
+     * Params: p_idle_handler - called (from interrupt) every time a radio event ends
+     */
+    void start(radio_idle_handler_t p_idle_handler)
+    {
+        radio_sync_state.idle_handler = p_idle_handler;
+        radio_sync_state.radio_active = false;
+
+        NVIC_ClearPendingIRQ(SWI1_IRQn);
+        NVIC_SetPriority(SWI1_IRQn, APP_IRQ_PRIORITY_LOW);
+        NVIC_EnableIRQ(SWI1_IRQn);
+
+        // 800us is the shortest distance, that still leaves time to finish a conversion started by mistake
+        uint32_t err_code = sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH, NRF_RADIO_NOTIFICATION_DISTANCE_800US);
+        APP_ERROR_CHECK(err_code);
+    }
+
+
+    /*
+     * Returns true if the radio is idle (no radio event running or about to start within NOTIFICATION_DISTANCE).
+     * An event whose end wasn't notified counts as ended RADIO_MAX_ACTIVE_TICKS after it started.
+     */
+    static bool isRadioIdle();
+};
+
+#endif
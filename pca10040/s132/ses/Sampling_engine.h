@@ -0,0 +1,292 @@
+#ifndef SAMPLING_ENGINE_H
+#define SAMPLING_ENGINE_H
+
+extern "C" {
+#include "nrf_drv_ppi.h"
+#include "nrf_drv_rtc.h"
+#include "nrf_drv_gpiote.h"
+#include "app_error.h"
+}
+
+#include "ADC.h"
+
+
+// Bridge is powered up this many RTC ticks (1 tick = 30.5us) before the conversion starts.
+const static uint32_t BRIDGE_LEAD_TICKS = 1;
+
+
+/*
+ * Class for autonomous pressure sampling. Instead of waking CPU for every sample, RTC2 compare events are connected
+ * through PPI to GPIOTE (bridge power) and SAADC:
+ *
+ *   RTC2 COMPARE[0]  ->  GPIOTE SET (BRIDGE_PIN high)
+ *   RTC2 COMPARE[1]  ->  SAADC SAMPLE, fork: RTC2 CLEAR (next period)
+ *   SAADC RESULTDONE ->  GPIOTE CLR (BRIDGE_PIN low)
+ *   SAADC END        ->  SAADC START (next batch buffer)
+ *
+ * Results are collected by EasyDMA in one of two buffers. CPU only wakes up when a buffer of batch_size samples is full.
+ * DCDC can't be switched by hardware, so unlike ADC::analogReadPressure() it stays enabled during conversions.
+ * SAADC is busy while the engine runs: call pause() before using ADC (Vbat, calibration) and resume() afterwards.
+ *
+ * Template parameters:
+ * bridge_pin - GPIO powering pressure sensor bridge
+ * batch_size - number of samples collected before CPU is woken up
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+class Sampling_engine
+{
+    static volatile int16_t buffers[2][batch_size];     // EasyDMA double buffer
+    static volatile uint8_t filling;     // index of the buffer being filled by EasyDMA
+    static volatile bool batch_ready;     // true when buffers[!filling] holds a full batch, that hasn't been read yet
+    static adc_done_handler_t batch_handler;
+
+    const nrf_drv_rtc_t rtc = NRF_DRV_RTC_INSTANCE(2);     // RTC0 is used by SoftDevice, RTC1 by app_timer
+    nrf_ppi_channel_t ppi_bridge_on;
+    nrf_ppi_channel_t ppi_sample;
+    nrf_ppi_channel_t ppi_bridge_off;
+    nrf_ppi_channel_t ppi_restart;
+    uint32_t period_ticks = 0;
+
+    static void saadcIrqHandler();
+    static void rtcHandler(nrf_drv_rtc_int_type_t p_int_type);
+    void startSaadc();
+    void stopSaadc();
+
+  public:
+    template <class Adc>
+    void start(Adc &p_adc, uint32_t p_period_ms, adc_done_handler_t p_batch_handler);
+    template <class Adc>
+    void resume(Adc &p_adc);
+    void pause();
+    bool readBatch(uint16_t &p_pressure_raw);
+};
+
+
+template <uint32_t bridge_pin, uint8_t batch_size>
+volatile int16_t Sampling_engine<bridge_pin, batch_size>::buffers[2][batch_size];
+
+template <uint32_t bridge_pin, uint8_t batch_size>
+volatile uint8_t Sampling_engine<bridge_pin, batch_size>::filling = 0;
+
+template <uint32_t bridge_pin, uint8_t batch_size>
+volatile bool Sampling_engine<bridge_pin, batch_size>::batch_ready = false;
+
+template <uint32_t bridge_pin, uint8_t batch_size>
+adc_done_handler_t Sampling_engine<bridge_pin, batch_size>::batch_handler = NULL;
+
+
+
+/*
+ * SAADC events, forwarded from SAADC_IRQHandler() while the engine runs.
+ * END - a batch is full (PPI has already restarted SAADC on the other buffer).
+ * STARTED - EasyDMA latched the buffer, so the pointer for the next batch can be written already.
+ * END is handled first, because both can be pending at once and STARTED needs the updated buffer index.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+void Sampling_engine<bridge_pin, batch_size>::saadcIrqHandler()
+{
+    if (NRF_SAADC->EVENTS_END)
+    {
+        NRF_SAADC->EVENTS_END = 0x00UL;
+        (void)NRF_SAADC->EVENTS_END;
+        filling = !filling;
+        batch_ready = true;
+        if (batch_handler != NULL)
+        {
+            batch_handler();
+        }
+    }
+    if (NRF_SAADC->EVENTS_STARTED)
+    {
+        NRF_SAADC->EVENTS_STARTED = 0x00UL;
+        (void)NRF_SAADC->EVENTS_STARTED;
+        NRF_SAADC->RESULT.PTR = (uint32_t)buffers[!filling];
+    }
+}
+
+
+
+// RTC interrupts are not used (compare events go through PPI only), but the driver requires a handler.
+template <uint32_t bridge_pin, uint8_t batch_size>
+void Sampling_engine<bridge_pin, batch_size>::rtcHandler(nrf_drv_rtc_int_type_t p_int_type)
+{
+}
+
+
+
+/*
+ * Sets up RTC2, PPI and GPIOTE and starts sampling. Call once, instead of starting the read timer.
+ * Params: p_adc - adc object, used to set SAADC channel up
+ *         p_period_ms - time between samples
+ *         p_batch_handler - called from the interrupt when a batch is ready (for example sets a flag)
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+template <class Adc>
+void Sampling_engine<bridge_pin, batch_size>::start(Adc &p_adc, uint32_t p_period_ms, adc_done_handler_t p_batch_handler)
+{
+    uint32_t err_code;
+    batch_handler = p_batch_handler;
+    period_ticks = (p_period_ms * RTC_INPUT_FREQ) / 1000;
+
+    nrf_drv_rtc_config_t rtc_config = NRF_DRV_RTC_DEFAULT_CONFIG;
+    rtc_config.prescaler = 0;     // 32768Hz, so that the bridge lead time is as short as possible
+    err_code = nrf_drv_rtc_init(&rtc, &rtc_config, rtcHandler);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_rtc_cc_set(&rtc, 0, period_ticks - BRIDGE_LEAD_TICKS, false);     // event only, no interrupt
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_rtc_cc_set(&rtc, 1, period_ticks, false);
+    APP_ERROR_CHECK(err_code);
+
+    if (!nrf_drv_gpiote_is_init())
+    {
+        err_code = nrf_drv_gpiote_init();
+        APP_ERROR_CHECK(err_code);
+    }
+    nrf_drv_gpiote_out_config_t bridge_config = GPIOTE_CONFIG_OUT_TASK_TOGGLE(false);     // bridge is off initially
+    err_code = nrf_drv_gpiote_out_init(bridge_pin, &bridge_config);
+    APP_ERROR_CHECK(err_code);
+    // GPIOTE driver configures standard drive, but the bridge is powered from this pin, so restore high drive (like ADC does)
+    nrf_gpio_cfg(bridge_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_DISCONNECT, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_S0H1, NRF_GPIO_PIN_NOSENSE);
+
+    err_code = nrf_drv_ppi_init();
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_bridge_on);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_sample);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_bridge_off);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_restart);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_bridge_on,
+                                          nrf_drv_rtc_event_address_get(&rtc, NRF_RTC_EVENT_COMPARE_0),
+                                          nrf_drv_gpiote_set_task_addr_get(bridge_pin));
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_assign(ppi_sample,
+                                          nrf_drv_rtc_event_address_get(&rtc, NRF_RTC_EVENT_COMPARE_1),
+                                          (uint32_t)&NRF_SAADC->TASKS_SAMPLE);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_fork_assign(ppi_sample, nrf_drv_rtc_task_address_get(&rtc, NRF_RTC_TASK_CLEAR));
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_assign(ppi_bridge_off,
+                                          (uint32_t)&NRF_SAADC->EVENTS_RESULTDONE,
+                                          nrf_drv_gpiote_clr_task_addr_get(bridge_pin));
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_assign(ppi_restart, (uint32_t)&NRF_SAADC->EVENTS_END, (uint32_t)&NRF_SAADC->TASKS_START);
+    APP_ERROR_CHECK(err_code);
+
+    resume(p_adc);
+}
+
+
+
+/*
+ * Private method for arming SAADC with an empty batch buffer. SAADC_IRQHandler() events are forwarded to the engine.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+void Sampling_engine<bridge_pin, batch_size>::startSaadc()
+{
+    filling = 0;
+    batch_ready = false;
+    saadc_job.irq_owner = saadcIrqHandler;
+
+    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos);
+    NRF_SAADC->RESULT.PTR = (uint32_t)buffers[0];
+    NRF_SAADC->RESULT.MAXCNT = batch_size;
+    NRF_SAADC->EVENTS_STARTED = 0x00UL;
+    NRF_SAADC->EVENTS_END = 0x00UL;
+    NRF_SAADC->EVENTS_RESULTDONE = 0x00UL;
+    NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+    NRF_SAADC->TASKS_START = 0x01UL;
+}
+
+
+
+/*
+ * Private method for stopping SAADC and giving it back to ADC. A batch that wasn't full yet is dropped.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+void Sampling_engine<bridge_pin, batch_size>::stopSaadc()
+{
+    NRF_SAADC->INTENCLR = SAADC_INTENCLR_STARTED_Msk | SAADC_INTENCLR_END_Msk;
+    saadc_job.irq_owner = NULL;
+
+    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    NRF_SAADC->TASKS_STOP = 0x01UL;
+    while (!NRF_SAADC->EVENTS_STOPPED);     // stopping takes a few cycles only
+    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    NRF_SAADC->EVENTS_STARTED = 0x00UL;
+    NRF_SAADC->EVENTS_END = 0x00UL;
+
+    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos);
+}
+
+
+
+/*
+ * Stops sampling, so that SAADC can be used by ADC (for example for Vbat or calibration). Bridge is turned off.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+void Sampling_engine<bridge_pin, batch_size>::pause()
+{
+    nrf_drv_rtc_disable(&rtc);     // no more compare events
+    nrf_drv_ppi_channel_disable(ppi_bridge_on);
+    nrf_drv_ppi_channel_disable(ppi_sample);
+    nrf_drv_ppi_channel_disable(ppi_bridge_off);
+    nrf_drv_ppi_channel_disable(ppi_restart);
+    nrf_drv_gpiote_out_task_disable(bridge_pin);
+    nrf_gpio_pin_clear(bridge_pin);
+    stopSaadc();
+}
+
+
+
+/*
+ * Resumes sampling after pause(). SAADC channel is set up again, because ADC could have changed it.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+template <class Adc>
+void Sampling_engine<bridge_pin, batch_size>::resume(Adc &p_adc)
+{
+    p_adc.setupForPressure();
+    startSaadc();
+
+    nrf_drv_gpiote_out_task_enable(bridge_pin);
+    nrf_drv_ppi_channel_enable(ppi_restart);
+    nrf_drv_ppi_channel_enable(ppi_bridge_off);
+    nrf_drv_ppi_channel_enable(ppi_sample);
+    nrf_drv_ppi_channel_enable(ppi_bridge_on);
+    nrf_drv_rtc_counter_clear(&rtc);
+    nrf_drv_rtc_enable(&rtc);
+}
+
+
+
+/*
+ * Reads the last full batch, if there is one.
+ * Params: p_pressure_raw - returns average of the batch, in the same units analogReadPressure() returns
+ * Returns: true if a new batch was read, false if there wasn't any since the last call.
+ */
+template <uint32_t bridge_pin, uint8_t batch_size>
+bool Sampling_engine<bridge_pin, batch_size>::readBatch(uint16_t &p_pressure_raw)
+{
+    if (!batch_ready)
+    {
+        return false;
+    }
+    batch_ready = false;
+
+    const volatile int16_t *batch = buffers[!filling];
+    int32_t sum = 0;
+    for (uint8_t i = 0; i < batch_size; i++)
+    {
+        sum += batch[i];
+    }
+    int32_t pressure_raw = (sum / batch_size) >> 1;	 // average, then remove useless noisy LSB, like analogReadPressure()
+    p_pressure_raw = (pressure_raw < 0) ? 0 : (uint16_t)pressure_raw;
+    return true;
+}
+
+
+#endif
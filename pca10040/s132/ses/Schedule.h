@@ -0,0 +1,16 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+
+// Inputs for schedule policies (task periods of Task_scheduler), updated by main() every reading.
+struct Schedule_inputs
+{
+    uint32_t seconds_since_wake;
+    uint32_t seconds_since_change;     // since pressure or temperature last changed
+    uint8_t bat_percentage;
+    bool alert;     // rapid deflation alert
+};
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+extern "C" {
+#include "app_timer.h"
+#include "app_scheduler.h"
+#include "app_error.h"
+}
+
+
+/*
+ * Task handler, runs in main() context (app_sched_execute()).
+ * Params: p_context - context given to Task_scheduler::add()
+ *         p_elapsed_ms - time since the task last ran (or since it was added) [ms]
+ */
+typedef void (*task_handler_t)(void *p_context, uint32_t p_elapsed_ms);
+
+
+
+/*
+ * Tickless scheduler of periodic tasks. Every task has its own period and slack (how late it may run). One single shot
+ * app_timer is programmed for the earliest deadline (due time + slack) of all tasks, so CPU wakes only when some task
+ * has to run. On every wake up, all tasks that are due run together, so a task with slack usually runs on the wake up
+ * of another task instead of waking CPU by itself.
+ *
+ * Timer interrupt only puts an event to app_scheduler, tasks are run by app_sched_execute() in main(), so they can
+ * block (SPI, SAADC). Call APP_SCHED_INIT() before start(). Don't call the methods from interrupts.
+ *
+ * Template parameters:
+ * MAX_TASKS - maximal number of tasks
+ */
+template <uint8_t MAX_TASKS>
+class Task_scheduler
+{
+    // the longest sleep, so the 24 bit RTC counter can't wrap around twice between two now() calls
+    static const uint32_t MAX_SLEEP_TICKS = APP_TIMER_MAX_CNT_VAL / 2;
+    // app_timer tick rate, RTC1 counts LFCLK divided by the prescaler (APP_TIMER_CONFIG_RTC_FREQUENCY + 1) [Hz]
+    static const uint32_t TICKS_PER_SECOND = APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1);
+
+    struct Task
+    {
+        task_handler_t handler;
+        void *context;
+        uint32_t period_ticks;
+        uint32_t slack_ticks;
+        uint32_t due;     // time the task should run [ticks]
+        uint32_t last_run;     // [ticks]
+    };
+
+    const app_timer_id_t timer_id;
+    Task tasks[MAX_TASKS];
+    uint8_t task_count = 0;
+    uint32_t time = 0;     // RTC counter extended to 32 bits [ticks]
+    uint32_t last_counter = 0;
+    bool started = false;
+    volatile bool dispatch_pending = false;
+
+
+    // Returns current time [ticks] (wraps around after 3 days, compare with isBefore()).
+    uint32_t now()
+    {
+        const uint32_t counter = app_timer_cnt_get();
+        time += app_timer_cnt_diff_compute(counter, last_counter);
+        last_counter = counter;
+        return time;
+    }
+
+
+    // Returns true if time p_a is before (or at) p_b, also across the 32 bit wrap around.
+    static bool isBefore(uint32_t p_a, uint32_t p_b)
+    {
+        return (int32_t)(p_a - p_b) <= 0;
+    }
+
+
+    static uint32_t msToTicks(uint32_t p_ms)
+    {
+        return APP_TIMER_TICKS(p_ms);
+    }
+
+
+    // Programs the timer for the earliest deadline.
+    void reprogram()
+    {
+        if (!started)
+        {
+            return;
+        }
+        const uint32_t time_now = now();
+        uint32_t sleep_ticks = MAX_SLEEP_TICKS;
+        for (uint8_t i = 0; i < task_count; i++)
+        {
+            const uint32_t deadline = tasks[i].due + tasks[i].slack_ticks;
+            const uint32_t ticks = isBefore(deadline, time_now) ? 0 : deadline - time_now;
+            if (ticks < sleep_ticks)
+            {
+                sleep_ticks = ticks;
+            }
+        }
+        if (sleep_ticks < APP_TIMER_MIN_TIMEOUT_TICKS)
+        {
+            sleep_ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+        }
+        uint32_t err_code = app_timer_stop(timer_id);
+        APP_ERROR_CHECK(err_code);
+        err_code = app_timer_start(timer_id, sleep_ticks, this);
+        APP_ERROR_CHECK(err_code);
+    }
+
+
+    // Runs all due tasks and programs the timer again.
+    void dispatch()
+    {
+        dispatch_pending = false;
+        for (uint8_t i = 0; i < task_count; i++)
+        {
+            Task &task = tasks[i];
+            const uint32_t time_now = now();
+            if (!isBefore(task.due, time_now))
+            {
+                continue;
+            }
+            task.due += task.period_ticks;
+            if (isBefore(task.due, time_now))     // fell behind by more than a period, don't try to catch up
+            {
+                task.due = time_now + task.period_ticks;
+            }
+            const uint32_t elapsed_ms = (uint64_t)(time_now - task.last_run) * 1000 / TICKS_PER_SECOND;
+            task.last_run = time_now;
+            task.handler(task.context, elapsed_ms);
+        }
+        reprogram();
+    }
+
+
+    // app_timer handler (interrupt), p_context is the Task_scheduler
+    static void timerHandler(void *p_context)
+    {
+        Task_scheduler *scheduler = (Task_scheduler *)p_context;
+        if (!scheduler->dispatch_pending)
+        {
+            scheduler->dispatch_pending = true;
+            uint32_t err_code = app_sched_event_put(&scheduler, sizeof(scheduler), dispatchEvent);
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+
+
+    // app_scheduler event handler, the event is a pointer to the Task_scheduler
+    static void dispatchEvent(void *p_event_data, uint16_t p_event_size)
+    {
+        (*(Task_scheduler **)p_event_data)->dispatch();
+    }
+
+  public:
+
+    // Params: p_timer_id - app_timer instance (APP_TIMER_DEF)
+    Task_scheduler(app_timer_id_t p_timer_id) : timer_id(p_timer_id)
+    {
+    }
+
+
+    /*
+     * Adds a periodic task. It first runs one period after it's added.
+     * Params: p_handler - task handler
+     *         p_context - passed to the handler
+     *         p_period_ms - period [ms]
+     *         p_slack_ms - how late the task may run [ms], so it can run together with another task
+     * Returns: task id
+     */
+    uint8_t add(task_handler_t p_handler, void *p_context, uint32_t p_period_ms, uint32_t p_slack_ms = 0)
+    {
+        APP_ERROR_CHECK_BOOL(task_count < MAX_TASKS);
+        Task &task = tasks[task_count];
+        task.handler = p_handler;
+        task.context = p_context;
+        task.period_ticks = msToTicks(p_period_ms);
+        task.slack_ticks = msToTicks(p_slack_ms);
+        task.last_run = now();
+        task.due = task.last_run + task.period_ticks;
+        reprogram();
+        return task_count++;
+    }
+
+
+    // Starts the scheduler. Call once, after APP_SCHED_INIT().
+    void start()
+    {
+        uint32_t err_code = app_timer_create(&timer_id, APP_TIMER_MODE_SINGLE_SHOT, timerHandler);
+        APP_ERROR_CHECK(err_code);
+        started = true;
+        reprogram();
+    }
+
+
+    /*
+     * Changes period of a task. The next run is one new period after the last one.
+     * Params: p_task - task id
+     *         p_period_ms - period [ms]
+     */
+    void setPeriod(uint8_t p_task, uint32_t p_period_ms)
+    {
+        Task &task = tasks[p_task];
+        const uint32_t period_ticks = msToTicks(p_period_ms);
+        if (period_ticks == task.period_ticks)
+        {
+            return;
+        }
+        task.period_ticks = period_ticks;
+        task.due = task.last_run + period_ticks;
+        reprogram();
+    }
+
+
+    // Makes a task due now, it runs on the next dispatch (or later in the current one). Params: p_task - task id
+    void trigger(uint8_t p_task)
+    {
+        tasks[p_task].due = now();
+        reprogram();
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef WARM_START_H
+#define WARM_START_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+extern "C" {
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "app_error.h"
+}
+
+
+// State kept over System OFF. Lives in .non_init, so startup code doesn't clear it.
+struct Retained_state
+{
+    uint32_t magic;
+    uint16_t pressure_kPa;     // last advertised readings
+    int16_t temperature;
+    uint8_t bat_percentage;
+    bool acc_configured;     // accelerometer was powered and set up for motion interrupt
+    uint16_t checksum;
+};
+
+static Retained_state retained_state __attribute__((section(".non_init")));
+
+
+
+/*
+ * Class for warm start after System OFF. Before System OFF, save() keeps the last readings in retained RAM and marks
+ * it in GPREGRET. When accelerometer wakes the chip up (reset with RESETREAS.OFF), check() returns true if the state
+ * is valid, so setup can advertise the last readings right away, instead of reading everything again first.
+ *
+ * Any other reset (power on, pin reset, watchdog, error) gives a cold start, because GPREGRET or RESETREAS don't match,
+ * or because RAM content isn't valid.
+ */
+class Warm_start
+{
+    static const uint32_t MAGIC = 0x5741524D;     // "WARM"
+    static const uint32_t GPREGRET_FLAG = 0x20;     // bit in GPREGRET, set while a valid state is retained
+    static const uint32_t RAM_START = 0x20000000;
+    static const uint32_t RAM_BLOCK_SIZE = 0x2000;     // nRF52832: 8 RAM blocks, 2 sections of 4 kB each
+    static const uint32_t RAM_SECTION_SIZE = 0x1000;
+
+    bool warm = false;
+
+
+    // Returns checksum of retained_state (without the checksum itself).
+    static uint16_t checksum()
+    {
+        const uint8_t *p_bytes = (const uint8_t *)&retained_state;
+        uint16_t sum = 0;
+        for (uint8_t i = 0; i < offsetof(Retained_state, checksum); i++)
+        {
+            sum = (uint16_t)((sum << 1) | (sum >> 15)) + p_bytes[i];     // rotate and add, catches swapped bytes
+        }
+        return sum ^ 0xA5A5;     // all zeros isn't valid
+    }
+
+
+    // Turns on System OFF retention of the RAM section, that holds retained_state.
+    static void retainRam()
+    {
+        const uint32_t offset = (uint32_t)&retained_state - RAM_START;
+        const uint8_t section = (offset % RAM_BLOCK_SIZE) / RAM_SECTION_SIZE;
+        const uint32_t mask = (section == 0) ? POWER_RAM_POWER_S0RETENTION_Msk : POWER_RAM_POWER_S1RETENTION_Msk;
+        uint32_t err_code = sd_power_ram_power_set(offset / RAM_BLOCK_SIZE, mask);
+        APP_ERROR_CHECK(err_code);
+    }
+
+  public:
+
+    /*
+     * Checks the reset reason and retained state. Call once, after the SoftDevice is enabled.
+     * Returns: true if this is a wake up from System OFF with a valid retained state
+     */
+    bool check()
+    {
+        uint32_t reset_reason = 0;
+        uint32_t gpregret = 0;
+        uint32_t err_code = sd_power_reset_reason_get(&reset_reason);
+        APP_ERROR_CHECK(err_code);
+        err_code = sd_power_reset_reason_clr(reset_reason);     // reset reasons accumulate until cleared
+        APP_ERROR_CHECK(err_code);
+        err_code = sd_power_gpregret_get(0, &gpregret);
+        APP_ERROR_CHECK(err_code);
+        err_code = sd_power_gpregret_clr(0, GPREGRET_FLAG);
+        APP_ERROR_CHECK(err_code);
+
+        warm = (reset_reason & POWER_RESETREAS_OFF_Msk) && (gpregret & GPREGRET_FLAG)
+               && retained_state.magic == MAGIC && retained_state.checksum == checksum();
+        retained_state.magic = 0;     // used once, a reset before the next save() is a cold start
+        return warm;
+    }
+
+
+    // Returns the result of check().
+    bool isWarm()
+    {
+        return warm;
+    }
+
+
+    // Returns retained state. Valid only if isWarm().
+    const Retained_state &getState()
+    {
+        return retained_state;
+    }
+
+
+    /*
+     * Saves state for the next start. Call just before System OFF.
+     * Params: p_pressure_kPa - advertised pressure [kPa]
+     *         p_temperature - advertised temperature [1/100 *C]
+     *         p_bat_percentage - advertised battery level [%]
+     *         p_acc_configured - true if accelerometer stays set up for motion interrupt
+     */
+    void save(uint16_t p_pressure_kPa, int16_t p_temperature, uint8_t p_bat_percentage, bool p_acc_configured)
+    {
+        retained_state.pressure_kPa = p_pressure_kPa;
+        retained_state.temperature = p_temperature;
+        retained_state.bat_percentage = p_bat_percentage;
+        retained_state.acc_configured = p_acc_configured;
+        retained_state.magic = MAGIC;
+        retained_state.checksum = checksum();
+        retainRam();
+        uint32_t err_code = sd_power_gpregret_set(0, GPREGRET_FLAG);
+        APP_ERROR_CHECK(err_code);
+    }
+};
+
+#endif
@@ -11,40 +11,241 @@
 #include "mapper.h"
 #include "measurments.h"
 #include "sd_func_wrapper.h"
+#include "Sampling_engine.h"
+#include "Oversample_controller.h"
+#include "Calibration_scheduler.h"
+#include "Radio_sync.h"
+#include "Calibration_table.h"
+#include "Leak_detector.h"
+#include "Deflation_detector.h"
+#include "Schedule.h"
+#include "Pressure_stats.h"
+#include "History_log.h"
+#include "History_service.h"
+#include "Fds_storage.h"
+#include "Flash_history.h"
+#include "Warm_start.h"
+#include "Boot_timeline.h"
+#include "Task_scheduler.h"
+
+
+
+// main() context only: interrupt handlers hand elapsed time over through app_scheduler (countElapsed())
+static bool timer_flag = false;
+static bool vbat_due = false;
+static uint32_t leak_sample_ms = 0;
+static uint32_t wake_ms = 0;
+static uint32_t deferred_ms = 0;     // reading due while the radio was active
+static bool adv_flag = false;
+// set from interrupts
+static volatile bool deferred_event_pending = false;     // radio idle event is in app_scheduler queue
+APP_TIMER_DEF(m_task_timer_id);
+static Task_scheduler<5> task_scheduler(m_task_timer_id);
+static uint8_t reading_task;
+static uint8_t adv_task;
+static History_log<(cfg::CONNECTABLE_HISTORY && !cfg::FLASH_HISTORY) ? cfg::HISTORY_CAPACITY : 1> history_log;     // global, too big for the stack
+static Fds_storage fds_storage;
+static Flash_history<cfg::FLASH_HISTORY ? cfg::HISTORY_BLOCK_WORDS : 4, cfg::HISTORY_MAX_BLOCKS, Fds_storage> flash_history(fds_storage);
+static const bool FLASH_HISTORY_USED = cfg::CONNECTABLE_HISTORY && cfg::FLASH_HISTORY;
+static Boot_timeline boot_timeline;
+
+
+
+// SoftDevice assert callback, declared in sd_func_wrapper.h
+void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
+{
+    app_error_handler(DEAD_BEEF, line_num, p_file_name);
+}
 
 
 
-static bool timer_flag = false;
-static uint8_t read_vbat_counter = 0;
-static uint16_t supervise_acc_counter = 0;
-APP_TIMER_DEF(m_app_timer_id);
+/*
+ * Function for signaling main() to read, and counting elapsed time for leak sampling and schedule policies.
+ * Call only from main() context (app_scheduler event handlers), the counters aren't protected from interrupts.
+ * Params: p_elapsed_ms - time elapsed since the last call [ms]
+ */
+static void countElapsed(uint32_t p_elapsed_ms)
+{
+    timer_flag = true;
+	leak_sample_ms += p_elapsed_ms;
+	wake_ms += p_elapsed_ms;
+}
 
 
 
 /*
- * Main timer handler function that gets called every timer interval. I put all the application code in main().
+ * Reading task handler, gets called every sampling interval. I put all the application code in main().
+ * With RADIO_SYNC_SAMPLING, a reading that falls on radio activity waits until the radio event ends.
  */
-static void app_timer_handler(void *p_context)
+static void sampling_task_handler(void *p_context, uint32_t p_elapsed_ms)
 {
-    timer_flag = true;
-    read_vbat_counter++;
-	supervise_acc_counter++;
+    if (cfg::RADIO_SYNC_SAMPLING && !Radio_sync::isRadioIdle())
+    {
+        deferred_ms += p_elapsed_ms;
+        return;
+    }
+    countElapsed(deferred_ms + p_elapsed_ms);
+    deferred_ms = 0;
 }
 
 
 
-/**@brief Function for starting timers.
+/*
+ * Battery task handler, gets called every READ_VBAT_INTERVAL_MS. Vbat is read with pressure (one SAADC session),
+ * so the reading is made due too (it usually is anyway, the task has slack to wait for it).
  */
-static void reading_timer_start(void)
+static void battery_task_handler(void *p_context, uint32_t p_elapsed_ms)
 {
-    uint32_t err_code = app_timer_create(&m_app_timer_id, APP_TIMER_MODE_REPEATED, app_timer_handler); // Create timers
-    APP_ERROR_CHECK(err_code);
-    err_code = app_timer_start(m_app_timer_id, READ_TIMER_INTERVAL, NULL);     // start main timer
+    vbat_due = true;
+    if (!cfg::AUTONOMOUS_SAMPLING)
+    {
+        task_scheduler.trigger(reading_task);
+    }
+}
+
+
+
+/*
+ * Accelerometer supervision task handler, gets called every SUPERVISE_ACC_INTERVAL_MS.
+ * Params: p_context - Adxl362 object
+ */
+template <class Acc>
+static void supervise_acc_task_handler(void *p_context, uint32_t p_elapsed_ms)
+{
+    ((Acc *)p_context)->superviseAcc();
+}
+
+
+
+/*
+ * History task handler, gets called every HISTORY_LOG_INTERVAL. Logs filtered readings, the same as advertised.
+ * Params: p_context - Measurments object
+ */
+template <class Meas>
+static void history_task_handler(void *p_context, uint32_t p_elapsed_ms)
+{
+    Meas &measurments = *(Meas *)p_context;
+    if (FLASH_HISTORY_USED)
+    {
+        flash_history.add(measurments.getPressure(), measurments.getTemperature());
+    }
+    else
+    {
+        history_log.add(measurments.getPressure(), measurments.getTemperature());
+    }
+}
+
+
+
+/*
+ * Advertising task handler, gets called every advertising interval (or later, on a reading wake up, the task has
+ * slack). Advertising data is updated at this pace, in main() after the reading of the same wake up.
+ */
+static void adv_task_handler(void *p_context, uint32_t p_elapsed_ms)
+{
+    adv_flag = true;
+}
+
+
+
+// app_scheduler event handler, counts a batch of Sampling_engine in main() context.
+static void batch_ready_event(void *p_event_data, uint16_t p_event_size)
+{
+    countElapsed(cfg::SAMPLING_BATCH * READ_INTERVAL);
+}
+
+
+
+/*
+ * Sampling_engine batch handler (SAADC interrupt), gets called every SAMPLING_BATCH samples. Replaces the reading task,
+ * when AUTONOMOUS_SAMPLING is on.
+ */
+static void batch_ready_handler(void)
+{
+    uint32_t err_code = app_sched_event_put(NULL, 0, batch_ready_event);
     APP_ERROR_CHECK(err_code);
 }
 
 
 
+// app_scheduler event handler, takes the reading deferred by sampling_task_handler() in main() context.
+static void radio_idle_event(void *p_event_data, uint16_t p_event_size)
+{
+    deferred_event_pending = false;
+    if (deferred_ms > 0)
+    {
+        countElapsed(deferred_ms);
+        deferred_ms = 0;
+    }
+}
+
+
+
+/*
+ * Radio notification handler (SWI1 interrupt), gets called every time a radio event ends. If a reading was deferred,
+ * it's taken in main() context. Nothing is deferred before the reading task runs, so app_scheduler is initialized by then.
+ */
+static void radio_idle_handler(void)
+{
+    if (deferred_ms > 0 && !deferred_event_pending)     // deferred_ms is only read here, a stale value is harmless
+    {
+        deferred_event_pending = true;
+        uint32_t err_code = app_sched_event_put(NULL, 0, radio_idle_event);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+
+
+/*
+ * Reading task period policy: sample fast when readings change or during alert (leaks and deflation are tracked 
+ * closely), slowly when readings haven't changed for long (parked), otherwise every READ_INTERVAL.
+ * Params: p_inputs - schedule inputs
+ * Returns: sampling interval [ms]
+ */
+static uint32_t samplingPolicy(const Schedule_inputs &p_inputs)
+{
+    if (p_inputs.alert || p_inputs.seconds_since_change < cfg::SAMPLING_FAST_AFTER_CHANGE)
+    {
+        return cfg::SAMPLING_INTERVAL_FAST_MS;
+    }
+    if (p_inputs.seconds_since_change > cfg::SAMPLING_PARKED_AFTER)
+    {
+        return cfg::SAMPLING_INTERVAL_PARKED_MS;
+    }
+    return READ_INTERVAL;
+}
+
+
+
+/*
+ * Function for mapping raw pressure to kPa: with temperature compensated calibration table if it is used (isUsed()),
+ * otherwise with linear fit.
+ * Params: p_cal_table - calibration table
+ *         p_pressure_raw - raw pressure reading
+ *         p_temperature - die temperature [1/100 *C]
+ */
+static uint16_t mapPressure(Calibration_table &p_cal_table, uint16_t p_pressure_raw, int32_t p_temperature)
+{
+	return p_cal_table.isUsed() ? p_cal_table.map(p_pressure_raw, p_temperature) : map(p_pressure_raw);
+}
+
+
+
+/*
+ * History_service reader, records come from flash_history or history_log.
+ */
+static uint16_t historyReader(uint32_t &p_sequence, History_record *p_records, uint16_t p_max)
+{
+    if (FLASH_HISTORY_USED)
+    {
+        return flash_history.read(p_sequence, p_records, p_max);
+    }
+    return history_log.read(p_sequence, p_records, p_max);
+}
+
+
+
 /*
  * Function for initializing app timer library. Call in setup.
  */
@@ -68,23 +269,117 @@ int main(void)
 
     bleStackInit();
 	enableDC2DC();
-    My_advertising advertiser;
-    advertiser.addIdToAddress(cfg::SENSOR_ID);		// attach sensor id to advertising buffer
+    boot_timeline.mark(Boot_phase::SOFTDEVICE_ENABLED);
+    Warm_start warm_start;
+    const bool warm = cfg::WARM_START && warm_start.check();      // woken up from System OFF, last readings are retained
 
-    ADC<cfg::BRIDGE_PIN, cfg::ADC_POSITIVE_INPUT, cfg::ADC_NEGATIVE_INPUT> adc;
+    // stage 1: start what takes long in background (app_timer, SAADC), then become visible as soon as the first values are known
+    Adxl362<cfg::SS_PIN, cfg::MOSI_PIN, cfg::MISO_PIN, cfg::SCLK_PIN, cfg::ACC_VCC_PIN> adxl362;
+    if (warm && warm_start.getState().acc_configured)
+    {
+        adxl362.resumeMotionInterrupt<cfg::ACC_INT_PIN, cfg::ACTIVITY_THRESHOLD, cfg::INACTIVITY_THRESHOLD, cfg::INACTIVITY_TIME>();     // accelerometer kept its setup in System OFF
+    }
+    else
+    {
+        adxl362.startMotionInterrupt<cfg::ACC_INT_PIN, cfg::ACTIVITY_THRESHOLD, cfg::INACTIVITY_THRESHOLD, cfg::INACTIVITY_TIME>();     // VCC power cycle and setup run under app_timer
+    }
 
-    adc.calibrate();       // do initial calibration
+    ADC<cfg::BRIDGE_PIN, cfg::ADC_POSITIVE_INPUT, cfg::ADC_NEGATIVE_INPUT, cfg::ADC_COMBINED_SCAN> adc;
+    Calibration_scheduler<cfg::ADC_CAL_MIN_THRESHOLD, cfg::ADC_CAL_MAX_THRESHOLD, cfg::ADC_CAL_MAX_DEFERRALS>
+        cal_scheduler(cfg::TEMP_ADC_CALIBRATE, cfg::ADC_CAL_ALLOWED_DRIFT);
+    cal_scheduler.request();       // do initial calibration (radio is idle yet, so don't wait)
+    cal_scheduler.start(adc, getTemperature());      // runs while the setup below goes on
+    boot_timeline.mark(Boot_phase::CALIBRATION_STARTED);
 
-    uint8_t bat_percentage = mapVbat(adc.analogReadVbat());		// bat percentage has to be "main global", since it is not read every loop iteration
-    Measurments<cfg::PRESSURE_SENSITIVITY_KPA, cfg::TEMP_SENSITIVITY, cfg::TEMP_ADC_CALIBRATE>
-        measurments(map(adc.analogReadPressure()), getTemperature(), bat_percentage);    // initialize measurments with real data
+    My_advertising advertiser;
+    advertiser.addIdToAddress(cfg::SENSOR_ID);		// attach sensor id to advertising buffer
+    APP_SCHED_INIT(sizeof(void *), cfg::SCHEDULER_QUEUE_SIZE);      // task handlers and history download run from app_sched_execute()
+    History_service history_service;
+    if (cfg::CONNECTABLE_HISTORY)
+    {
+        history_service.init(historyReader);      // GATT table has to be complete before the central connects
+    }
 
-    advertiser.configureAdvertising(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage());     // setup advertising
+    Calibration_table cal_table;
+    cal_table.load();      // factory table from flash, if there is one
+
+    // readings noise (3 sigma) should stay below PRESSURE_SENSITIVITY_KPA, converted to raw units (variance * 256)
+    // with ADC_BURST_FILTER the controller chooses burst length instead of oversampling (both are log2 of averaged samples)
+    const float max_noise_raw = cfg::PRESSURE_SENSITIVITY_KPA / (3 * cfg::A_COEFFICIENT);
+    typedef decltype(adc) Adc;
+    Oversample_controller<cfg::OVERSAMPLE_WINDOW, cfg::ADC_BURST_FILTER ? Adc::BURST_LOG2_MIN : SAADC_OVERSAMPLE_OVERSAMPLE_Bypass,
+                          cfg::ADC_BURST_FILTER ? Adc::BURST_LOG2_MAX : SAADC_OVERSAMPLE_OVERSAMPLE_Over256x>
+        oversample_controller((uint32_t)(256 * max_noise_raw * max_noise_raw), cfg::ADC_BURST_FILTER ? adc.getPressureBurst() : adc.getPressureOversample());
+
+    uint16_t pressure_raw = 0;
+    uint16_t vbat_raw;
+    uint8_t bat_percentage;		// bat percentage has to be "main global", since it is not read every loop iteration
+    uint16_t initial_pressure_kPa;
+    int16_t initial_temperature;
+    if (warm)      // advertise the last readings at once, the first reading follows on the first sampling tick
+    {
+        initial_pressure_kPa = warm_start.getState().pressure_kPa;
+        initial_temperature = warm_start.getState().temperature;
+        bat_percentage = warm_start.getState().bat_percentage;
+    }
+    else
+    {
+        cal_scheduler.finish(adc);      // on warm start, it finishes in background, before the first reading
+        adc.analogReadPressureAndVbat(pressure_raw, vbat_raw);
+        bat_percentage = mapVbat(vbat_raw);
+        initial_temperature = getTemperature();
+        initial_pressure_kPa = mapPressure(cal_table, pressure_raw, initial_temperature);
+    }
+    boot_timeline.mark(Boot_phase::FIRST_READING);
+    Measurments<cfg::PRESSURE_SENSITIVITY_KPA, cfg::TEMP_SENSITIVITY, cfg::TEMP_ADC_CALIBRATE,
+                cfg::PRESSURE_PROCESS_NOISE, cfg::PRESSURE_MEASUREMENT_NOISE, cfg::TEMP_PROCESS_NOISE, cfg::TEMP_MEASUREMENT_NOISE>
+        measurments(initial_pressure_kPa, initial_temperature, bat_percentage);    // initialize measurments with real (or retained) data
+
+    Leak_detector<cfg::LEAK_WINDOW, cfg::LEAK_SAMPLE_INTERVAL, cfg::LEAK_RATE_THRESHOLD> leak_detector;
+    Deflation_detector<cfg::DEFLATION_DRIFT_KPA, cfg::DEFLATION_THRESHOLD_KPA_S, cfg::DEFLATION_ALERT_HOLD_MS>
+        deflation_detector(measurments.getPressure());
+    Pressure_stats pressure_stats(measurments.getPressure());
+
+    advertiser.setCalibrationId(cal_table.getId());
+    advertiser.setTelemetry(pressure_stats.getMin(), pressure_stats.getMax(), pressure_stats.getAverage(), leak_detector.getRate());
+    advertiser.configureAdvertising(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage(), 
+                                    leak_detector.isLeaking(), leak_detector.getRate());     // setup advertising
+    Radio_sync radio_sync;
+    radio_sync.start(radio_idle_handler);      // radio notification can't be configured while advertising
+    advertiser.startAdvertising();      // become visible (start advertising)
+    boot_timeline.mark(Boot_phase::ADVERTISING_STARTED);
+
+    // stage 2: everything that isn't needed for the first advertisement
+    if (FLASH_HISTORY_USED)
+    {
+        fds_storage.init();
+        flash_history.load();      // history logged before System OFF
+    }
+    boot_timeline.mark(Boot_phase::STORAGE_READY);
 
-    reading_timer_start();     // start system main timer
-    Adxl362<cfg::SS_PIN, cfg::MOSI_PIN, cfg::MISO_PIN, cfg::SCLK_PIN, cfg::ACC_VCC_PIN> adxl362;
-    adxl362.setupMotionInterrupt<cfg::ACC_INT_PIN, cfg::ACTIVITY_THRESHOLD, cfg::INACTIVITY_THRESHOLD, cfg::INACTIVITY_TIME>();     // setup accelerometer for motion interrupt
-    advertiser.startAdvertising();      // lastly: become visible (start advertising)
+    Sampling_engine<cfg::BRIDGE_PIN, cfg::SAMPLING_BATCH> sampling_engine;
+    task_scheduler.add(battery_task_handler, NULL, cfg::READ_VBAT_INTERVAL_MS, cfg::TASK_SLACK_MS);
+    task_scheduler.add(supervise_acc_task_handler<decltype(adxl362)>, &adxl362, cfg::SUPERVISE_ACC_INTERVAL_MS, cfg::TASK_SLACK_MS);
+    if (cfg::CONNECTABLE_HISTORY)
+    {
+        task_scheduler.add(history_task_handler<decltype(measurments)>, &measurments, cfg::HISTORY_LOG_INTERVAL * 1000UL, cfg::TASK_SLACK_MS);
+    }
+    if (cfg::AUTONOMOUS_SAMPLING)
+    {
+        cal_scheduler.finish(adc);      // SAADC is owned by the engine from now on
+        sampling_engine.start(adc, READ_INTERVAL, batch_ready_handler);     // sample every READ_INTERVAL, wake up every batch
+    }
+    else
+    {
+        reading_task = task_scheduler.add(sampling_task_handler, NULL, READ_INTERVAL);     // no slack, readings keep their pace
+    }
+    adv_task = task_scheduler.add(adv_task_handler, NULL, ADV_INTERVAL, cfg::TASK_SLACK_MS);
+    task_scheduler.start();
+    Schedule_inputs schedule_inputs = {0, 0, bat_percentage, false};
+    uint32_t last_change_ms = 0;
+    uint32_t last_reading_ms = 0;     // wake_ms at the previous reading
+    bool adv_data_pending = false;
+    boot_timeline.mark(Boot_phase::SETUP_DONE);
 
 #ifdef ADXL362_DEBUG
 	int i = 0;
@@ -92,8 +387,9 @@ int main(void)
     ///////////////////////////////////// LOOP /////////////////////////////////////////
     while (1)
     {
+        app_sched_execute();      // runs due tasks (Task_scheduler), they signal readings with timer_flag, advertising with adv_flag
 
-        if (timer_flag)       // do every second
+        if (timer_flag)       // do every sampling interval
         {
 
 #ifdef ADXL362_DEBUG
@@ -105,52 +401,193 @@ int main(void)
 #endif
 
             timer_flag = false;      // reset timer flag
+            cal_scheduler.finish(adc);      // calibration started in the previous iteration has to end before reading
             const int16_t temperature = getTemperature();		 // read temperature
-            if (measurments.checkIfAdcNeedsCal(temperature))       // if the temperature changed sufficiently, calibrate ADC
+            if (measurments.checkIfAdcNeedsCal(temperature, cal_scheduler.getThreshold()))       // if the temperature changed sufficiently, calibrate ADC
             {
-                adc.calibrate();
+                cal_scheduler.request();      // started at the end of the iteration
             }
 
-			if (supervise_acc_counter > cfg::SUPERVISE_ACC_INTERVAL)
-			{
-				supervise_acc_counter = 0;
-				adxl362.superviseAcc();
-			}
-
-            if (read_vbat_counter > cfg::READ_VBAT_INTERVAL)	   // battery percentage is read less often than pressure or temperature
+            if (cfg::AUTONOMOUS_SAMPLING)
+            {
+                sampling_engine.readBatch(pressure_raw);      // average of the batch collected by hardware
+                if (vbat_due)
+                {
+                    vbat_due = false;
+                    sampling_engine.pause();      // SAADC is owned by the engine
+                    bat_percentage = mapVbat(adc.analogReadVbat());
+                    sampling_engine.resume(adc);
+                }
+            }
+            else if (vbat_due)	   // battery percentage is read less often than pressure or temperature (battery task)
+            {
+                vbat_due = false;
+                adc.analogReadPressureAndVbat(pressure_raw, vbat_raw);      // one session for both, if ADC_COMBINED_SCAN
+                bat_percentage = mapVbat(vbat_raw);      // map Vbat (Vcc) to %s
+            }
+            else
             {
-                read_vbat_counter = 0;      // reset Vbat reading counter
-                bat_percentage = mapVbat(adc.analogReadVbat());      // read Vbat (Vcc) and map it to %s
+                if (cfg::ADC_BURST_FILTER)
+                {
+                    pressure_raw = adc.analogReadPressureBurst();
+                    if (cfg::ADC_ADAPTIVE_OVERSAMPLE)
+                    {
+                        adc.setPressureBurst(oversample_controller.update(pressure_raw));     // only burst readings tell about burst noise
+                    }
+                }
+                else
+                {
+                    pressure_raw = adc.analogReadPressure();
+                    if (cfg::ADC_ADAPTIVE_OVERSAMPLE)
+                    {
+                        adc.setPressureOversample(oversample_controller.update(pressure_raw));     // only oversampled readings tell about noise
+                    }
+                }
             }
 
 #ifdef CALIBRATION
 			
 			// if calibration is enabled, raw readings (without any mappings or checkings are advertised)
-			uint16_t pressure = map(adc.analogReadPressure());
+			uint16_t pressure = map(pressure_raw);
             //printf("Pressure: %d\n", pressure);
 
-            advertiser.updateAdvertising(adc.analogReadPressure(), temperature, bat_percentage);
+            advertiser.updateAdvertising(pressure_raw, temperature, bat_percentage, false, 0);
 
 #else	// advertise converted and filtered readings
 			
+			// every reading is mapped: the estimator, leak and deflation detectors and stats need in-band readings too
+			const uint16_t pressure_kPa = mapPressure(cal_table, pressure_raw, temperature);
+
+			// rapid deflation is checked on every reading, before any filtering, so that the alert is as fast as possible
+			const uint32_t reading_elapsed_ms = wake_ms - last_reading_ms;     // the reading period varies (samplingPolicy)
+			last_reading_ms = wake_ms;
+			advertiser.serviceBurst(reading_elapsed_ms);
+			const bool was_alert = deflation_detector.isAlert();
+			const bool alert_raised = deflation_detector.update(pressure_kPa, reading_elapsed_ms);
+			const bool alert_changed = (was_alert != deflation_detector.isAlert());
+			advertiser.setAlert(deflation_detector.isAlert());
+
+			// stats of every reading, extended telemetry is passed to the advertiser every advertising interval
+			if (cfg::ADV_TELEMETRY)
+			{
+				pressure_stats.add(pressure_kPa);
+			}
+
 			// check if measured values changed since the previous readings. It is done to prevent displaying noisy readings
-            if (measurments.checkForChanges(map(adc.analogReadPressure()), temperature, bat_percentage))
+			const bool readings_changed = measurments.checkForChanges(pressure_kPa, temperature, bat_percentage);
+
+			// leak detector gets filtered readings: a single raw reading would make the slope jitter, and getPressure() only
+			// moves in PRESSURE_SENSITIVITY_KPA steps, far coarser than a slow leak over the window
+			bool leak_changed = false;
+			if (leak_sample_ms >= cfg::LEAK_SAMPLE_INTERVAL * 1000UL)
+			{
+				leak_sample_ms = 0;
+				leak_changed = leak_detector.addSample(measurments.getFilteredPressure(), measurments.getFilteredTemperature());
+			}
+
+            if (readings_changed || leak_changed || alert_changed)
             {
-				// if they changed, update transmitted data
-                advertiser.updateAdvertising(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage());
+				// if they changed, transmitted data is updated on the next advertising task run
+				adv_data_pending = true;
             }
+			if (measurments.getReadingsSinceChange() == 0)
+			{
+				last_change_ms = wake_ms;
+			}
+			if (alert_raised)      // alert can't wait for the advertising schedule
+			{
+				adv_data_pending = false;
+				advertiser.updateAdvertising(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage(), 
+				                             leak_detector.isLeaking(), leak_detector.getRate());
+				advertiser.startAlertBurst(cfg::ALERT_BURST_MS);      // send it as often as possible
+			}
+
+			schedule_inputs.seconds_since_wake = wake_ms / 1000;
+			schedule_inputs.seconds_since_change = (wake_ms - last_change_ms) / 1000;
+			schedule_inputs.bat_percentage = bat_percentage;
+			schedule_inputs.alert = deflation_detector.isAlert();
+			if (!cfg::AUTONOMOUS_SAMPLING)
+			{
+				if (cfg::ADAPTIVE_SAMPLING)
+				{
+					task_scheduler.setPeriod(reading_task, samplingPolicy(schedule_inputs));
+				}
+			}
 
 
 #endif // CALIBRATION
 
+            // calibrate in background, while CPU sleeps until the next reading
+            if (cal_scheduler.shouldStart(radio_sync.isRadioIdle()))
+            {
+                if (cfg::AUTONOMOUS_SAMPLING)
+                {
+                    sampling_engine.pause();      // SAADC is owned by the engine, so calibration can't run in background
+                    cal_scheduler.start(adc, temperature);
+                    cal_scheduler.finish(adc);
+                    sampling_engine.resume(adc);
+                }
+                else
+                {
+                    cal_scheduler.start(adc, temperature);
+                }
+            }
+
 #ifndef CALIBRATION
-            if (0 == nrf_gpio_pin_read(cfg::ACC_INT_PIN))	 // check if there's no motion detected for 2 mins (accelerometer signals an inactivity interrupt)
+            if (adxl362.isReady() && 0 == nrf_gpio_pin_read(cfg::ACC_INT_PIN))	 // check if there's no motion detected for 2 mins (accelerometer signals an inactivity interrupt)
             {
+                while (FLASH_HISTORY_USED && !flash_history.flush())     // block being filled would be lost in System OFF
+                {
+                    idle_state_handle();
+                }
+                if (cfg::WARM_START)
+                {
+                    warm_start.save(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage(), true);
+                }
                 sleepSysOffEnter();     // go to system off sleep mode (the wake up source is accelerometer pin)
             }
 #endif // CALIBRATION
         }
 
+#ifndef CALIBRATION
+        if (adv_flag)       // do every advertising interval
+        {
+            adv_flag = false;
+            if (cfg::ADV_TELEMETRY)
+            {
+                advertiser.setTelemetry(pressure_stats.getMin(), pressure_stats.getMax(), pressure_stats.getAverage(), 
+                                        leak_detector.getRate());
+            }
+            if (adv_data_pending)
+            {
+                adv_data_pending = false;
+                advertiser.updateAdvertising(measurments.getPressure(), measurments.getTemperature(), measurments.getBatPercentage(), 
+                                             leak_detector.isLeaking(), leak_detector.getRate());
+            }
+            advertiser.serviceFrame();
+            if (cfg::ADAPTIVE_ADVERTISING)
+            {
+                const uint32_t adv_interval_ms = My_advertising::intervalPolicy(schedule_inputs);
+                task_scheduler.setPeriod(adv_task, adv_interval_ms);
+                advertiser.setInterval(adv_interval_ms);
+            }
+        }
+#endif // CALIBRATION
+
+        if (cfg::CONNECTABLE_HISTORY)
+        {
+            advertiser.serviceConnection();      // advertising is started again after disconnection
+        }
+        if (FLASH_HISTORY_USED)
+        {
+            flash_history.service();      // writes a full block, when FDS is free
+        }
+        if (!boot_timeline.isMarked(Boot_phase::ACC_READY) && adxl362.isReady())      // the last boot phase, done in background
+        {
+            boot_timeline.mark(Boot_phase::ACC_READY);
+            boot_timeline.print();
+        }
+
         idle_state_handle();       // go to system ON sleep mode (until next timer interrupt)
     }
 }
\ No newline at end of file
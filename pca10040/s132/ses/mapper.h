@@ -6,13 +6,53 @@
 #include <stdint.h>
 
 
+// map() works in fixed point: coefficients are scaled by 2^MAP_FRACTION_BITS at compile time
+const uint8_t MAP_FRACTION_BITS = 16;
+const uint16_t MAP_MAX_RAW = 2047;     // pressure readings are 11 bit (12 bit adc, noisy LSB removed)
+
+
+
+// Converts a coefficient to fixed point (rounded to nearest). Compile time only.
+constexpr int32_t toFixed(float p_value)
+{
+	return (int32_t)(p_value * (float)(1UL << MAP_FRACTION_BITS) + (p_value < 0 ? -0.5f : 0.5f));
+}
+
+
+
+// Absolute difference between a coefficient and its fixed point representation. Compile time only.
+constexpr float fixedError(float p_value)
+{
+	return (p_value - (float)toFixed(p_value) / (float)(1UL << MAP_FRACTION_BITS)) < 0
+	       ? -(p_value - (float)toFixed(p_value) / (float)(1UL << MAP_FRACTION_BITS))
+	       : (p_value - (float)toFixed(p_value) / (float)(1UL << MAP_FRACTION_BITS));
+}
+
+
+
+static constexpr int32_t A_FIXED = toFixed(cfg::A_COEFFICIENT);
+static constexpr int32_t B_FIXED = toFixed(cfg::B_COEFFICIENT);
+
+// worst case difference against float a * pressure + b is at the end of adc range (far below 1kPa resolution)
+static_assert(fixedError(cfg::A_COEFFICIENT) * MAP_MAX_RAW + fixedError(cfg::B_COEFFICIENT) < 0.05f,
+              "fixed point map() differs from float reference by more than 0.05kPa");
+static_assert((int64_t)A_FIXED * MAP_MAX_RAW + (B_FIXED < 0 ? -(int64_t)B_FIXED : (int64_t)B_FIXED) <= INT32_MAX,
+              "fixed point map() overflows int32_t, lower MAP_FRACTION_BITS");
+
+
+
 /*
  * Function for mapping pressure using linear equation, with a, b coefficients taken from my_config.h.
+ * Uses fixed point coefficients, so it's one integer multiply-add (no FPU). Rounds toward zero like the float
+ * cast did (>> alone would floor negative values). test/test_mapper.cpp checks it against the float formula.
  * Params: pressure raw pressure reading from adc.
  */
 inline uint16_t map(uint16_t pressure)
 {
-	int32_t result = (int32_t)((float)pressure * cfg::A_COEFFICIENT + cfg::B_COEFFICIENT);
+	int32_t scaled = (int32_t)pressure * A_FIXED + B_FIXED;
+	if (scaled < 0)
+		scaled += (1L << MAP_FRACTION_BITS) - 1;
+	int32_t result = scaled >> MAP_FRACTION_BITS;
 	if (result < 20)     // constrain to 0, values < 20kPa (0.2bar), so that can cast to int and the sensor doesn't show something like 0.01 insted of 0
 		result = 0;
 	return (uint16_t)result;
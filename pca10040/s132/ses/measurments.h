@@ -3,11 +3,81 @@
 
 #include <stdint.h>
 #include <cmath>
+#include <cstdlib>
+
+
+/* Fixed point scalar Kalman filter (random walk model) for one measured channel. Values are kept in Q8 (value * 256),
+ * variances in Q8 of squared units.
+ *
+ * A reading further than INNOVATION_GATE sigmas from the estimate means the value really jumped (for example tire 
+ * deflates), so the estimate variance is raised by 4 * MEASUREMENT_NOISE (gain goes above 0.8) and the filter follows
+ * within a few readings. Otherwise gain settles at ~sqrt(PROCESS_NOISE / MEASUREMENT_NOISE) and noise is averaged out.
+ *
+ * Template parameters:
+ * PROCESS_NOISE_Q8 - variance of the real value change between two readings [unit^2 / 256]
+ * MEASUREMENT_NOISE_Q8 - variance of a single reading [unit^2 / 256]
+ */
+template <uint32_t PROCESS_NOISE_Q8, uint32_t MEASUREMENT_NOISE_Q8>
+class Estimator
+{
+	static const int64_t INNOVATION_GATE_SQ = 9;     // 3 sigma
+
+	int32_t estimate_q8;
+	uint32_t variance_q8;
+
+  public:
+
+	Estimator(int32_t p_initial)
+	{
+		estimate_q8 = p_initial << 8;
+		variance_q8 = MEASUREMENT_NOISE_Q8;
+	}
+
+	// Updates the estimate with a new reading.
+	void update(int32_t p_reading)
+	{
+		variance_q8 += PROCESS_NOISE_Q8;
+		int64_t innovation_q8 = ((int64_t)p_reading << 8) - estimate_q8;
+		if (innovation_q8 * innovation_q8 > INNOVATION_GATE_SQ * ((int64_t)variance_q8 + MEASUREMENT_NOISE_Q8) * 256)
+		{
+			variance_q8 += MEASUREMENT_NOISE_Q8 * 4;     // not noise - trust new readings more
+		}
+		int64_t gain_q16 = ((int64_t)variance_q8 << 16) / ((int64_t)variance_q8 + MEASUREMENT_NOISE_Q8);
+		estimate_q8 += (int32_t)((innovation_q8 * gain_q16) >> 16);
+		variance_q8 = (uint32_t)(((int64_t)variance_q8 * ((1 << 16) - gain_q16)) >> 16);
+	}
+
+	// Returns filtered value, rounded.
+	int32_t get()
+	{
+		return (estimate_q8 + 128) >> 8;
+	}
+
+	// Returns variance of the filtered value [unit^2 / 256].
+	uint32_t getVariance()
+	{
+		return variance_q8;
+	}
+
+	/* 
+	 * Checks if filtered value differs from p_value significantly: by more than p_sensitivity and by more than
+	 * SIGNIFICANCE_SQ sigmas of the estimate.
+	 */
+	bool differsFrom(int32_t p_value, int32_t p_sensitivity)
+	{
+		static const int64_t SIGNIFICANCE_SQ = 4;     // 2 sigma
+		int64_t difference_q8 = (int64_t)estimate_q8 - ((int64_t)p_value << 8);
+		return (llabs(difference_q8) > ((int64_t)p_sensitivity << 8)) &&
+		       (difference_q8 * difference_q8 > SIGNIFICANCE_SQ * (int64_t)variance_q8 * 256);
+	}
+};
+
 
 
 /* Class for checking if new readings should be displayed. The goal is to prevent displaying readings with noisy last 
- * digit. It is achieved by comparing the difference between current readings and previous readings against some delta
- * (sensitivity) and displaying only those that pass this test.
+ * digit. Pressure and temperature readings are filtered by Estimator, and the filtered value is displayed only if it 
+ * changed significantly since the last displayed one: more than some delta (sensitivity) and more than the estimate's
+ * own uncertainty. So noise bursts don't cause updates, while real changes are followed quickly.
  *
  * Template parameters:
  * PRESSURE_SENSITIVITY_KPA - the difference between pressure readings has to be larger than this to 
@@ -16,14 +86,20 @@
  * make checkForChanges return true 
  * ADC_CAL_THRESHOLD - the difference between temperature readings has to be larger than this to 
  * make checkIfAdcNeedsCal return true
+ * PRESSURE_PROCESS_NOISE, PRESSURE_MEASUREMENT_NOISE - pressure Estimator tuning [kPa^2 / 256]
+ * TEMP_PROCESS_NOISE, TEMP_MEASUREMENT_NOISE - temperature Estimator tuning [(1/100 *C)^2 / 256]
  */
-template <int16_t PRESSURE_SENSITIVITY_KPA, int16_t TEMP_SENSITIVITY, int16_t ADC_CAL_THRESHOLD>
+template <int16_t PRESSURE_SENSITIVITY_KPA, int16_t TEMP_SENSITIVITY, int16_t ADC_CAL_THRESHOLD,
+          uint32_t PRESSURE_PROCESS_NOISE, uint32_t PRESSURE_MEASUREMENT_NOISE, uint32_t TEMP_PROCESS_NOISE, uint32_t TEMP_MEASUREMENT_NOISE>
 class Measurments
 {
     uint16_t prev_pressure_kPa;      // remembers last pressure advertised
 	int16_t prev_temperature;
 	uint8_t prev_bat_percentage;
 	int16_t temp_adc_last_cal;
+	uint16_t readings_since_change = 0;
+	Estimator<PRESSURE_PROCESS_NOISE, PRESSURE_MEASUREMENT_NOISE> pressure_estimator;
+	Estimator<TEMP_PROCESS_NOISE, TEMP_MEASUREMENT_NOISE> temp_estimator;
 
   public:
 
@@ -31,6 +107,7 @@ class Measurments
 	 * Constructor initializes Measurments with: pressure, temperature, bat percentage.
 	 */
     Measurments(uint16_t prev_pressure_kPa, int16_t prev_temperature, uint8_t prev_bat_percentage)
+        : pressure_estimator(prev_pressure_kPa), temp_estimator(prev_temperature)
     {
         this->prev_pressure_kPa = prev_pressure_kPa;
         this->prev_temperature = prev_temperature;
@@ -50,23 +127,47 @@ class Measurments
 		return prev_bat_percentage;
 	}
 
+	// Returns filtered pressure [kPa]. Unlike getPressure() it follows every reading, not only significant changes.
+	uint16_t getFilteredPressure() {
+		int32_t filtered_pressure = pressure_estimator.get();
+		return (filtered_pressure < 0) ? 0 : (uint16_t)filtered_pressure;
+	}
+
+	// Returns filtered temperature [1/100 *C]. Unlike getTemperature() it follows every reading.
+	int16_t getFilteredTemperature() {
+		return (int16_t)temp_estimator.get();
+	}
+
+	// Returns number of checkForChanges() calls since pressure or temperature last changed. Tells how stable readings are.
+	uint16_t getReadingsSinceChange() {
+		return readings_since_change;
+	}
+
+	// Returns variance of filtered pressure [kPa^2 / 256]. Tells how much the displayed pressure can be trusted.
+	uint32_t getPressureVariance() {
+		return pressure_estimator.getVariance();
+	}
+
 
 	/* 
-	 * Method for checking, if new readings are different than remembered, more than some delta (sensitivity).
-	 * Call every time new readings are acquired. If current readings (parameters) are different,
-	 * old readings are updated with new readings and true is returned.
+	 * Method for checking, if filtered readings are significantly different than remembered.
+	 * Call every time new readings are acquired. If filtered readings are different,
+	 * old readings are updated with filtered readings and true is returned.
 	 */
     bool checkForChanges(uint16_t pressure_kPa, int16_t temperature, uint8_t bat_percentage)
     {
-        bool pressure_changed, temp_changed, bat_perc_changed = false;
-        if (abs((int32_t)prev_pressure_kPa - (int32_t)pressure_kPa) > PRESSURE_SENSITIVITY_KPA)
+        bool pressure_changed = false, temp_changed = false, bat_perc_changed = false;
+        pressure_estimator.update(pressure_kPa);
+        temp_estimator.update(temperature);
+        if (pressure_estimator.differsFrom(prev_pressure_kPa, PRESSURE_SENSITIVITY_KPA))
         {
-            prev_pressure_kPa = pressure_kPa;
+            int32_t filtered_pressure = pressure_estimator.get();
+            prev_pressure_kPa = (filtered_pressure < 0) ? 0 : (uint16_t)filtered_pressure;
             pressure_changed = true;
         }
-        if (abs(prev_temperature - temperature) > TEMP_SENSITIVITY)
+        if (temp_estimator.differsFrom(prev_temperature, TEMP_SENSITIVITY))
         {
-            prev_temperature = temperature;
+            prev_temperature = (int16_t)temp_estimator.get();
             temp_changed = true;
         }
 		if (bat_percentage < prev_bat_percentage)	 // bat percentage should only decrease (there's no charger or anything like that)
@@ -75,17 +176,26 @@ class Measurments
 		bat_perc_changed = true;
 		}
 
+		if (pressure_changed || temp_changed)
+		{
+			readings_since_change = 0;
+		}
+		else if (readings_since_change < UINT16_MAX)
+		{
+			readings_since_change++;
+		}
+
         return (pressure_changed || temp_changed || bat_perc_changed);
 	}
 
 
 
     /* Checks if adc needs calibration (if current temperature is different than the temperature of last calibration 
-	 * by some threshold (ADC_CAL_THRESHOLD).
+	 * by some threshold (ADC_CAL_THRESHOLD by default, or threshold learned by Calibration_scheduler).
 	 */
-	bool checkIfAdcNeedsCal(int16_t temperature)
+	bool checkIfAdcNeedsCal(int16_t temperature, int16_t threshold = ADC_CAL_THRESHOLD)
 	{
-		if (abs(temp_adc_last_cal - temperature) > ADC_CAL_THRESHOLD)
+		if (abs(temp_adc_last_cal - temperature) > threshold)
 		{
 			temp_adc_last_cal = temperature;
 			return true;
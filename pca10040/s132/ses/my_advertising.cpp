@@ -1,18 +1,46 @@
 #include "my_advertising.h"
 
 
+#define ADVERTISING_BLE_OBSERVER_PRIO 2
+
+static My_advertising *p_advertiser = NULL;     // instance, that gets BLE events
+
+NRF_SDH_BLE_OBSERVER(m_advertising_obs, ADVERTISING_BLE_OBSERVER_PRIO, My_advertising::bleEventHandler, NULL);
+
+
+
 /* 
  * Constructor, initializes advertising settings
  */
 My_advertising::My_advertising()
 {
+    p_advertiser = this;
     m_adv_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET;
     memset(&m_adv_params, 0, sizeof(m_adv_params));   // zero m_adv_params
 
-    m_adv_params.properties.type = BLE_GAP_ADV_TYPE_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;      // my sensor is unconnectable (it's a broadcaster only)
+    if (cfg::CONNECTABLE_HISTORY)     // gateway connects to download history
+    {
+        m_adv_params.properties.type = cfg::EXTENDED_ADVERTISING ? BLE_GAP_ADV_TYPE_EXTENDED_CONNECTABLE_NONSCANNABLE_UNDIRECTED
+                                                                 : BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
+    }
+    else if (cfg::EXTENDED_ADVERTISING)
+    {
+        m_adv_params.properties.type = BLE_GAP_ADV_TYPE_EXTENDED_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;
+    }
+    else
+    {
+        m_adv_params.properties.type = cfg::SCANNABLE_ADVERTISING ? BLE_GAP_ADV_TYPE_NONCONNECTABLE_SCANNABLE_UNDIRECTED     // scan response carries telemetry
+                                                                  : BLE_GAP_ADV_TYPE_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;      // my sensor is unconnectable (it's a broadcaster only)
+    }
+    if (cfg::EXTENDED_ADVERTISING)
+    {
+        m_adv_params.primary_phy = BLE_GAP_PHY_1MBPS;     // ADV_EXT_IND on primary channels is always 1M
+        m_adv_params.secondary_phy = BLE_GAP_PHY_2MBPS;     // payload (AUX_ADV_IND) on 2M - half the airtime
+    }
     m_adv_params.p_peer_addr = NULL;     // Undirected advertisement. Sends packets to everyone
     m_adv_params.filter_policy = BLE_GAP_ADV_FP_ANY;
     m_adv_params.interval = ADVERTISING_INTERVAL;     // ADVERTISING interval is defined in my_config.h
+    policy_interval = ADVERTISING_INTERVAL;
     m_adv_params.duration = 0;     // Advertising never times out
 }
 
@@ -47,40 +75,292 @@ void My_advertising::addIdToAddress(const Sensor_id &p_sensor_id)
  *		   p_temperature - initial temperature to be advertised in [1/100 *C]
  *         p_bat_percentage - initial battery percentage to be advertised
  *         p_leak - initial pressure leak flag to be advertised.
+ *         p_leak_rate - initial pressure change rate to be advertised in [0.1kPa/h]
  */
-void My_advertising::configureAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage)
+void My_advertising::configureAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage,
+                                      const bool p_leak, const int16_t p_leak_rate)
 {
-    ble_buffer.setPressTempLeak(p_pressure, p_temperature, p_bat_percentage);
+    ble_buffer.setAlert(alert);
+    ble_buffer.setPressTempLeak(p_pressure, p_temperature, p_bat_percentage, p_leak, p_leak_rate);
+    p_adv_data = ble_buffer.getBuffer();
     uint32_t err_code;
-    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, ble_buffer.getBuffer(), &m_adv_params);
+    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, p_adv_data, &m_adv_params);
     APP_ERROR_CHECK(err_code);
 }
 
 
 
 /*
- * Function for starting advertising.
+ * Function for starting advertising. While a central is connected, it isn't started (SoftDevice supports 1 connection),
+ * serviceConnection() starts it after disconnection.
  */
 void My_advertising::startAdvertising()
 {
+    if (connected)
+    {
+        return;
+    }
     uint32_t err_code;
-    err_code = sd_ble_gap_adv_start(m_adv_handle, BLE_CONN_CFG_TAG_DEFAULT);
-    APP_ERROR_CHECK(err_code);
+    err_code = sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG);
+    if (err_code != NRF_ERROR_CONN_COUNT)     // a central has just connected, its BLE event isn't handled yet
+    {
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
 
 
 /*
- * Function for updating advertising.
+ * Function for updating advertising. SoftDevice isn't touched if the encoded data doesn't change.
  * Params: p_pressure - new pressure to be advertised in [kPa]
  *		   p_temperature - new temperature to be advertised in [1/100 *C]
  *         p_bat_percentage - new battery percentage to be advertised
  *         p_leak - new pressure leak flag to be advertised [true - leak detected, false - not].
+ *         p_leak_rate - new pressure change rate to be advertised in [0.1kPa/h]
+ */
+void My_advertising::updateAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage,
+                                      const bool p_leak, const int16_t p_leak_rate)
+{
+    ble_buffer.setAlert(alert);
+    ble_buffer.setPressTempLeak(p_pressure, p_temperature, p_bat_percentage, p_leak, p_leak_rate);
+    applyBuffer();
+}
+
+
+
+/*
+ * Function for alternating full and compact frame (see COMPACT_FRAME in my_config.h) and passing telemetry changed 
+ * by setTelemetry() to the SoftDevice. Call every advertising task run (main()).
+ */
+void My_advertising::serviceFrame()
+{
+    if (cfg::COMPACT_FRAME)
+    {
+        frame_count++;
+        if (frame_count >= cfg::FULL_FRAME_EVERY)
+        {
+            frame_count = 0;
+        }
+        ble_buffer.setFullFrame(frame_count == 0);
+    }
+    applyBuffer();
+}
+
+
+
+/*
+ * Function for updating extended telemetry (see SCANNABLE_ADVERTISING and EXTENDED_ADVERTISING in my_config.h). It is advertised with 
+ * the next updateAdvertising() or serviceFrame().
+ * Params: p_pressure_min - minimal pressure since wake up in [kPa]
+ *         p_pressure_max - maximal pressure since wake up in [kPa]
+ *         p_pressure_avg - average pressure since wake up in [kPa]
+ *         p_leak_rate - pressure change rate in [0.1kPa/h]
+ */
+void My_advertising::setTelemetry(uint16_t p_pressure_min, uint16_t p_pressure_max, uint16_t p_pressure_avg, int16_t p_leak_rate)
+{
+    ble_buffer.setTelemetry(p_pressure_min, p_pressure_max, p_pressure_avg, p_leak_rate);
+}
+
+
+
+/*
+ * Function for setting calibration table id advertised in extended telemetry. Call before configureAdvertising().
+ * Params: p_cal_id - calibration table id
+ */
+void My_advertising::setCalibrationId(uint16_t p_cal_id)
+{
+    ble_buffer.setCalibrationId(p_cal_id);
+}
+
+
+
+/*
+ * Function for passing new advertising data to the SoftDevice. SoftDevice isn't touched if the encoded data doesn't change.
+ */
+void My_advertising::applyBuffer()
+{
+    ble_gap_adv_data_t *next_adv_data = ble_buffer.getBuffer();
+    if (next_adv_data == NULL)     // advertised data is already up to date
+    {
+        return;
+    }
+    p_adv_data = next_adv_data;
+    uint32_t err_code;
+    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, p_adv_data, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+
+/*
+ * Function for setting rapid deflation alert flag. It is advertised with the next updateAdvertising().
+ * Params: p_alert - true - alert, false - no alert
+ */
+void My_advertising::setAlert(bool p_alert)
+{
+    alert = p_alert;
+}
+
+
+
+/*
+ * Function for starting alert burst: advertising continues with the current data, but at the minimal interval, 
+ * so the phone gets the alert as soon as possible. Call after updateAdvertising() with the alert flag.
+ * Params: p_duration_ms - burst length [ms], counted by serviceBurst()
+ */
+void My_advertising::startAlertBurst(uint32_t p_duration_ms)
+{
+    burst_left_ms = p_duration_ms;
+    restartAdvertising(BLE_GAP_ADV_INTERVAL_MIN);
+}
+
+
+
+/*
+ * Function for ending alert burst, when it's time. Call every reading.
+ * Params: p_elapsed_ms - time since the previous call [ms]
+ */
+void My_advertising::serviceBurst(uint32_t p_elapsed_ms)
+{
+    if (burst_left_ms == 0)
+    {
+        return;
+    }
+    burst_left_ms = (burst_left_ms > p_elapsed_ms) ? burst_left_ms - p_elapsed_ms : 0;
+    if (burst_left_ms == 0)
+    {
+        restartAdvertising(policy_interval);     // back to normal
+    }
+}
+
+
+
+/*
+ * Advertising task period policy, also the SoftDevice advertising interval: fast after wake up and after readings change (someone may be looking at
+ * the phone, or the tire is being pumped), slow when readings are stable, even slower when the battery is low too.
+ * Params: p_inputs - schedule inputs
+ * Returns: advertising interval [ms]
+ */
+uint32_t My_advertising::intervalPolicy(const Schedule_inputs &p_inputs)
+{
+    if (p_inputs.seconds_since_wake < cfg::ADV_FAST_AFTER_WAKE || p_inputs.seconds_since_change < cfg::ADV_FAST_AFTER_CHANGE)
+    {
+        return cfg::ADV_INTERVAL_FAST_MS;
+    }
+    if (p_inputs.bat_percentage < cfg::ADV_LOW_BAT_PERCENTAGE)
+    {
+        return cfg::ADV_INTERVAL_LOW_BAT_MS;
+    }
+    return cfg::ADV_INTERVAL_SLOW_MS;
+}
+
+
+
+/*
+ * Function for setting advertising interval. Advertising is restarted only if the interval changes.
+ * During alert burst the new interval is applied after the burst.
+ * Params: p_interval_ms - advertising interval [ms]
+ */
+void My_advertising::setInterval(uint32_t p_interval_ms)
+{
+    policy_interval = MSEC_TO_UNITS(p_interval_ms, UNIT_0_625_MS);
+    if (burst_left_ms == 0 && policy_interval != m_adv_params.interval)
+    {
+        restartAdvertising(policy_interval);
+    }
+}
+
+
+
+/*
+ * Function for changing advertising interval. Advertising parameters can't be changed while advertising,
+ * so it is stopped, reconfigured (with the buffer being advertised) and started again.
+ * Params: p_interval - new advertising interval in 0.625ms units
  */
-void My_advertising::updateAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage)
+void My_advertising::restartAdvertising(uint32_t p_interval)
 {
-    ble_buffer.setPressTempLeak(p_pressure, p_temperature, p_bat_percentage);
     uint32_t err_code;
-    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, ble_buffer.getBuffer(), NULL);
+    err_code = sd_ble_gap_adv_stop(m_adv_handle);
+    if (err_code != NRF_ERROR_INVALID_STATE)     // not advertising - nothing to stop
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+    m_adv_params.interval = p_interval;
+    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, p_adv_data, &m_adv_params);
     APP_ERROR_CHECK(err_code);
+    startAdvertising();
 }
+
+
+
+/*
+ * Function for starting advertising again after disconnection (CONNECTABLE_HISTORY). SoftDevice stops advertising
+ * on connection. Call every main loop iteration.
+ */
+void My_advertising::serviceConnection()
+{
+    if (!restart_pending)
+    {
+        return;
+    }
+    restart_pending = false;
+    uint32_t err_code = sd_ble_gap_adv_stop(m_adv_handle);     // restartAdvertising() may have started it already
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+    startAdvertising();
+}
+
+
+
+/*
+ * Function for tracking connection state, so advertising isn't started while a central is connected.
+ * Runs in the SoftDevice interrupt.
+ */
+void My_advertising::onBleEvent(ble_evt_t const *p_ble_evt)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            connected = true;
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            connected = false;
+            restart_pending = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+
+// Returns number of advertising updates, that reconfigured advertising data.
+uint32_t My_advertising::getAppliedUpdates()
+{
+    return ble_buffer.getAppliedCount();
+}
+
+
+
+// Returns number of advertising updates skipped, because the data didn't change.
+uint32_t My_advertising::getSkippedUpdates()
+{
+    return ble_buffer.getSkippedCount();
+}
+
+
+
+/*
+ * SoftDevice BLE event handler (observer).
+ */
+void My_advertising::bleEventHandler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+    if (p_advertiser != NULL)
+    {
+        p_advertiser->onBleEvent(p_ble_evt);
+    }
+}
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "Sensor_id.h"
 #include "my_config.h"
 #include "fds.h"
+#include "Schedule.h"
 
 /*
  * Class responsible for bluetooth advertising.
@@ -16,13 +17,38 @@ class My_advertising
     Ble_buffer ble_buffer;	    // Advertising data buffer wrapper
     uint8_t m_adv_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET;
     ble_gap_adv_params_t m_adv_params;
+    ble_gap_adv_data_t *p_adv_data = NULL;     // buffer being advertised
+    bool alert = false;
+    uint32_t burst_left_ms = 0;     // time left until the alert burst ends
+    uint32_t policy_interval;     // interval set by setInterval(), used outside of alert burst
+    uint8_t frame_count = 0;     // advertising intervals since the last full frame
+    volatile bool connected = false;     // set by BLE events (SoftDevice interrupt)
+    volatile bool restart_pending = false;     // central disconnected, advertising has to be started again
+
+    void restartAdvertising(uint32_t p_interval);
+    void applyBuffer();
+    void onBleEvent(ble_evt_t const *p_ble_evt);
 
   public:
     My_advertising();
     void addIdToAddress(const Sensor_id &p_sensor_id);
-    void configureAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage);
+    void configureAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage,
+                              const bool p_leak, const int16_t p_leak_rate);
     void startAdvertising();
-	void updateAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage);
+    void setAlert(bool p_alert);
+    void startAlertBurst(uint32_t p_duration_ms);
+    void serviceBurst(uint32_t p_elapsed_ms);
+    void serviceFrame();
+    void setTelemetry(uint16_t p_pressure_min, uint16_t p_pressure_max, uint16_t p_pressure_avg, int16_t p_leak_rate);
+    void setCalibrationId(uint16_t p_cal_id);
+    void serviceConnection();
+    void setInterval(uint32_t p_interval_ms);
+    static uint32_t intervalPolicy(const Schedule_inputs &p_inputs);
+	void updateAdvertising(const uint16_t p_pressure, const int16_t p_temperature, const uint8_t p_bat_percentage,
+                              const bool p_leak, const int16_t p_leak_rate);
+    uint32_t getAppliedUpdates();
+    uint32_t getSkippedUpdates();
+    static void bleEventHandler(ble_evt_t const *p_ble_evt, void *p_context);
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #include "Sensor_id.h"
 #include "my_utility.h"
+#include "Ad_frame.h"
+#include <type_traits>
 #include "nrf_sdh_ble.h"
 
 namespace cfg
@@ -22,26 +24,118 @@ constexpr const Sensor_id SENSOR_ID {{0x00, 0x00, 0x07}};
 
 ////////////////////////////////////////////// ADVERTISING DATA ///////////////////////////////////////////l
 
-const uint16_t ADV_DATA_L = 28;
-
-
-// The advertising data packet contains: device ID, pressure, temperature, battery percentage
-const uint8_t MY_ADV_DATA[ADV_DATA_L] = {
-
-    0x02, BLE_GAP_AD_TYPE_FLAGS, BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE,     // original sensor has 0x05 here (LE_LIMITED_DISC_MODE),    
-    13, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, 
-	0x00, 0x01,     // manufacturer TOMTOM international. Even more weird, since the original sensors are sold no - branded
-	0xBE, 0xEF,     // Beacon identifier
-	SENSOR_ID.id_hex[0], SENSOR_ID.id_hex[1], SENSOR_ID.id_hex[2], 
-	0x00, 0x00,     // pressure in kPa
-	0x00, 0x00,     // temperature in *C * 100
-	0x00,			// battery percentage
-	10, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, 
-	char('E'), char('z'), char('_'),
-	upperHalfByteToAscii<SENSOR_ID.id_hex[0]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[0]>(), 
-	upperHalfByteToAscii<SENSOR_ID.id_hex[1]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[1]>(), 
-	upperHalfByteToAscii<SENSOR_ID.id_hex[2]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[2]>()
-};
+// advertising frame slots (type defines slot size)
+struct Pressure_field { typedef uint16_t type; };     // pressure in kPa
+struct Temperature_field { typedef int16_t type; };     // temperature in *C * 100
+struct Battery_field { typedef uint8_t type; };     // battery percentage
+struct Status_field { typedef uint8_t type; };     // status flags (bit 0 - slow leak, bit 1 - rapid deflation alert)
+struct Leak_rate_field { typedef int16_t type; };     // pressure change rate in 0.1kPa/h (negative - pressure drops)
+struct Pressure_min_field { typedef uint16_t type; };     // minimal pressure since wake up in kPa
+struct Pressure_max_field { typedef uint16_t type; };     // maximal pressure since wake up in kPa
+struct Pressure_avg_field { typedef uint16_t type; };     // average pressure since wake up in kPa
+struct Cal_id_field { typedef uint16_t type; };     // calibration table id
+struct Telemetry_leak_rate_field { typedef int16_t type; };     // leak rate in telemetry (tags must be unique in a frame)
+
+
+// Advertising modes:
+// SCANNABLE_ADVERTISING - legacy scannable advertising, the scan response carries extended telemetry. It is transmitted 
+//                         only when an active scanner asks for it, so the primary packet stays short.
+// EXTENDED_ADVERTISING - BLE 5 extended advertising: short ADV_EXT_IND on primary channels (1M PHY), payload with extended 
+//                        telemetry in AUX_ADV_IND on 2M PHY (half the airtime per byte, no 31 byte limit). 
+//                        Phones without BLE 5 (2M PHY + extended advertising) don't see the sensor at all.
+// Both false - legacy non-scannable advertising, compatible with the original sensor and every phone.
+const bool SCANNABLE_ADVERTISING = false;
+const bool EXTENDED_ADVERTISING = false;
+static_assert(!(SCANNABLE_ADVERTISING && EXTENDED_ADVERTISING), "choose one advertising mode (extended scannable advertising can't carry advertising data)");
+const bool ADV_TELEMETRY = SCANNABLE_ADVERTISING || EXTENDED_ADVERTISING;     // extended telemetry is advertised
+const uint8_t FW_VERSION_MAJOR = 1;
+const uint8_t FW_VERSION_MINOR = 0;
+
+
+// The advertising data packet contains: device ID, pressure, temperature, battery percentage, status flags, leak rate
+typedef Ad_structure<BLE_GAP_AD_TYPE_FLAGS, 
+    Ad_bytes<BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE>> Adv_flags;     // original sensor has 0x05 here (LE_LIMITED_DISC_MODE)
+typedef Ad_structure<BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA,
+    Ad_bytes<0x00, 0x01>,     // manufacturer TOMTOM international. Even more weird, since the original sensors are sold no - branded
+    Ad_bytes<0xBE, 0xEF>,     // Beacon identifier
+    Ad_bytes<SENSOR_ID.id_hex[0], SENSOR_ID.id_hex[1], SENSOR_ID.id_hex[2]>,
+    Ad_slot<Pressure_field>,
+    Ad_slot<Temperature_field>,
+    Ad_slot<Battery_field>,
+    Ad_slot<Status_field>,
+    Ad_slot<Leak_rate_field>> Adv_manufacturer_data;
+typedef Ad_structure<BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME,
+    Ad_bytes<'E', 'z', '_',
+             upperHalfByteToAscii<SENSOR_ID.id_hex[0]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[0]>(), 
+             upperHalfByteToAscii<SENSOR_ID.id_hex[1]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[1]>(), 
+             upperHalfByteToAscii<SENSOR_ID.id_hex[2]>(), lowerHalfByteToAscii<SENSOR_ID.id_hex[2]>()>> Adv_name;
+
+// Extended telemetry contains: device ID, min / max / average pressure since wake up, leak rate, firmware version, calibration id
+typedef Ad_structure<BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA,
+    Ad_bytes<0x00, 0x01>,     // same manufacturer as advertising data
+    Ad_bytes<0xBE, 0xF0>,     // telemetry identifier (advertising data has 0xBEEF)
+    Ad_bytes<SENSOR_ID.id_hex[0], SENSOR_ID.id_hex[1], SENSOR_ID.id_hex[2]>,
+    Ad_slot<Pressure_min_field>,
+    Ad_slot<Pressure_max_field>,
+    Ad_slot<Pressure_avg_field>,
+    Ad_slot<Telemetry_leak_rate_field>,
+    Ad_bytes<FW_VERSION_MAJOR, FW_VERSION_MINOR>,
+    Ad_slot<Cal_id_field>> Adv_telemetry;
+
+// name must stay last (see compact frame). Extended advertising carries telemetry in advertising data, legacy - in scan response
+typedef std::conditional<EXTENDED_ADVERTISING, Ad_frame<Adv_flags, Adv_manufacturer_data, Adv_telemetry, Adv_name>,
+                                               Ad_frame<Adv_flags, Adv_manufacturer_data, Adv_name>>::type Adv_frame;
+typedef Ad_frame<Adv_telemetry> Scan_frame;
+typedef std::conditional<EXTENDED_ADVERTISING, Adv_frame, Scan_frame>::type Telemetry_frame;     // frame, that carries telemetry
+
+const uint16_t ADV_DATA_L = Adv_frame::SIZE;
+static_assert(ADV_DATA_L <= (EXTENDED_ADVERTISING ? BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED : BLE_GAP_ADV_SET_DATA_SIZE_MAX), 
+              "advertising frame doesn't fit in an advertising packet (31 bytes legacy, 255 bytes extended)");
+const uint16_t SCAN_RSP_DATA_L = Scan_frame::SIZE;
+static_assert(SCAN_RSP_DATA_L <= BLE_GAP_ADV_SET_DATA_SIZE_MAX, "scan response doesn't fit in a legacy scan response packet (31 bytes)");
+
+
+// Compact frame is the full frame without the name (and optionally without flags). Only manufacturer data is needed 
+// to identify the sensor, so most advertising events send the compact frame (11 - 14 bytes less on air on every channel).
+// Full frame is still sent every FULL_FRAME_EVERY advertising task runs, so apps looking for the name find the sensor.
+const bool COMPACT_FRAME = true;
+const bool COMPACT_FRAME_FLAGS = true;     // when false, compact frame drops flags too (allowed, sensor is non-connectable)
+const uint8_t FULL_FRAME_EVERY = 10;     // every n-th advertising task run (an interval or a bit more) sends the full frame
+const uint8_t COMPACT_FRAME_START = COMPACT_FRAME_FLAGS ? 0 : Adv_flags::bytes::SIZE;     // offset of compact frame in the full frame
+const uint8_t COMPACT_FRAME_L = Adv_frame::SIZE - Adv_name::bytes::SIZE - COMPACT_FRAME_START;
+
+
+////////////////////////////////////////////// HISTORY DOWNLOAD //////////////////////////////////////////////////////
+
+// When true, advertising is connectable and History_service lets a gateway download logged pressure / temperature history.
+// sdk_config.h is set up for it (ATT MTU 247, data length 251, 1 vendor UUID). When false, bleStackInit() configures
+// the SoftDevice with default ATT MTU and no vendor UUID, as RAM_START in the project (0x20002250) is sized for.
+// When true, SoftDevice needs more RAM: raise RAM_START (and lower RAM_SIZE) in the project to the minimum that
+// nrf_sdh_ble_enable() logs, otherwise it fails with NRF_ERROR_NO_MEM.
+const bool CONNECTABLE_HISTORY = false;
+const uint16_t HISTORY_CAPACITY = 2048;     // number of records kept in RAM (4 bytes each), 2048 * 5 min = 7 days
+const uint16_t HISTORY_LOG_INTERVAL = 5 * 60;     // a record is logged every HISTORY_LOG_INTERVAL seconds
+const uint8_t HISTORY_HVN_TX_QUEUE_SIZE = 8;     // notifications queued in the SoftDevice, so every connection event is filled up
+const uint16_t HISTORY_MIN_CONN_INTERVAL = MSEC_TO_UNITS(7.5, UNIT_1_25_MS);     // short interval for a short, fast transfer
+const uint16_t HISTORY_MAX_CONN_INTERVAL = MSEC_TO_UNITS(15, UNIT_1_25_MS);
+const uint16_t HISTORY_CONN_SUP_TIMEOUT = MSEC_TO_UNITS(4000, UNIT_10_MS);
+// When true, history is logged to flash (Flash_history in FDS pages) instead of RAM, so it survives System OFF.
+// Block of 252 words + FDS record header fills a quarter of a 1024 word FDS virtual page, FDS_VIRTUAL_PAGES - 1 pages
+// hold data (one is for garbage collection): 8 blocks, about 500 records each. A page (4 blocks) is freed at once,
+// so 4 to 8 blocks are kept (test/test_flash_history.cpp prints the numbers).
+const bool FLASH_HISTORY = true;
+const uint16_t HISTORY_BLOCK_WORDS = 252;
+const uint8_t HISTORY_MAX_BLOCKS = (FDS_VIRTUAL_PAGES - 1) * 4;
+static_assert((HISTORY_BLOCK_WORDS + 3) * 4 <= FDS_VIRTUAL_PAGE_SIZE - 2, "4 history blocks must fit in a FDS page");
+#define APP_BLE_CONN_CFG_TAG 1     // tag identifying the SoftDevice BLE configuration
+static_assert(!(CONNECTABLE_HISTORY && COMPACT_FRAME && !COMPACT_FRAME_FLAGS), "connectable advertising must keep flags");
+
+
+////////////////////////////////////////////////// WARM START ////////////////////////////////////////////////////////
+
+// When true, the last readings are kept in retained RAM over System OFF. After wake up, setup advertises them at once,
+// instead of waiting for initial calibration, readings and accelerometer setup (Warm_start.h).
+const bool WARM_START = true;
 
 
 ////////////////////////////////////////////////// PINS //////////////////////////////////////////////////////////////
@@ -68,8 +162,39 @@ const uint16_t INACTIVITY_TIME = 120;      // 120s
 
 /////////////////////////////////////////// PRESSURE CALIBRATION PARAMETERS ///////////////////////////////////////////
 
-const float A_COEFFICIENT = 2.1333;
-const float B_COEFFICIENT = -81.597;
+constexpr float A_COEFFICIENT = 2.1333;
+constexpr float B_COEFFICIENT = -81.597;
+
+// Temperature compensated calibration table (used by Calibration_table instead of the linear fit above, if CAL_TABLE_MAPPING).
+// Rows are die temperatures (getTemperature()), columns are raw adc readings, values are pressure in 0.1kPa.
+// Raw axis: CAL_RAW_MIN + i * 2^CAL_RAW_STEP_SHIFT, temperature axis: CAL_TEMP_MIN + j * CAL_TEMP_STEP [1/100 *C].
+// Values below come from the linear fit (no temperature compensation), replace them with measured points.
+// The table covers raw 0 to 1024 (~2100kPa, int16_t 0.1kPa can't go much further), readings above are clamped to its edge,
+// so the linear fit (full raw range) stays the default. A valid factory table in flash is used regardless.
+const bool CAL_TABLE_MAPPING = false;
+const uint8_t CAL_RAW_POINTS = 9;
+const uint8_t CAL_TEMP_POINTS = 4;
+const int16_t CAL_RAW_MIN = 0;
+const uint8_t CAL_RAW_STEP_SHIFT = 7;     // = 128 raw
+const int16_t CAL_TEMP_MIN = -2000;     // = -20*C
+const int16_t CAL_TEMP_STEP = 3000;     // = 30*C
+constexpr int16_t CAL_TABLE_DKPA[CAL_TEMP_POINTS][CAL_RAW_POINTS] = {
+    {-816, 1915, 4645, 7376, 10107, 12837, 15568, 18298, 21029},     // -20*C
+    {-816, 1915, 4645, 7376, 10107, 12837, 15568, 18298, 21029},     // 10*C
+    {-816, 1915, 4645, 7376, 10107, 12837, 15568, 18298, 21029},     // 40*C
+    {-816, 1915, 4645, 7376, 10107, 12837, 15568, 18298, 21029},     // 70*C
+};
+// Factory table page (written by the programmer). FDS puts its pages at the end of flash (no bootloader), the table
+// page goes right below them. The application flash in the emProject (FLASH_START + FLASH_SIZE) ends at the table page,
+// and flash_placement.xml reserves everything from there on, so the linker can't place code over the table or FDS.
+const uint32_t CODE_FLASH_END = 0x80000;     // nRF52832_xxAA
+const uint32_t FLASH_PAGE_BYTES = 0x1000;
+const uint32_t APP_FLASH_END = 0x7C000;     // = FLASH_START + FLASH_SIZE in ble_app_template_pca10040_s132.emProject
+const uint32_t CAL_FLASH_ADDRESS = 0x7C000;
+const uint32_t FDS_FLASH_START = CODE_FLASH_END - (FDS_VIRTUAL_PAGES + FDS_VIRTUAL_PAGES_RESERVED) * FDS_VIRTUAL_PAGE_SIZE * 4;
+static_assert(FDS_VIRTUAL_PAGE_SIZE * 4 == FLASH_PAGE_BYTES, "FDS virtual page must be a flash page");
+static_assert(CAL_FLASH_ADDRESS + FLASH_PAGE_BYTES <= FDS_FLASH_START, "calibration page overlaps FDS pages");
+static_assert(CAL_FLASH_ADDRESS >= APP_FLASH_END, "calibration page is in the application flash, reduce FLASH_SIZE");
 
 
 
@@ -78,21 +203,66 @@ const float B_COEFFICIENT = -81.597;
 const int32_t PRESSURE_SENSITIVITY_KPA = 6;     // 60 mBar
 const int32_t TEMP_SENSITIVITY = 600;     // 6 *C
 
+// Measurments filter tuning, variances * 256 (process: real change between readings, measurement: single reading noise)
+const uint32_t PRESSURE_PROCESS_NOISE = 3;     // ~(0.1kPa)^2
+const uint32_t PRESSURE_MEASUREMENT_NOISE = 4 * 256;     // (2kPa)^2
+const uint32_t TEMP_PROCESS_NOISE = 100 * 256;     // (0.1*C)^2
+const uint32_t TEMP_MEASUREMENT_NOISE = 625 * 256;     // (0.25*C)^2
+
+const uint8_t LEAK_WINDOW = 32;     // leak rate is estimated from LEAK_WINDOW samples (LEAK_SAMPLE_INTERVAL apart)
+const int16_t LEAK_RATE_THRESHOLD = 20;     // 2kPa/h, faster pressure loss is reported as a leak
+
+const int16_t DEFLATION_DRIFT_KPA = 2;     // pressure drop, that is ignored by rapid deflation detector (the sum drains by it every second)
+const int16_t DEFLATION_THRESHOLD_KPA_S = 20;     // accumulated pressure drop over time, that raises rapid deflation alert [kPa * s]
+const uint32_t DEFLATION_ALERT_HOLD_MS = 60 * 1000;     // alert flag is advertised this long after the drop stops
+const uint32_t ALERT_BURST_MS = 5 * 1000;     // after an alert is raised, advertising runs at minimal interval this long
+
+
+
+///////////////////////////////////////////////// ADC MODE ///////////////////////////////////////////////////////////
+
+const bool ADC_COMBINED_SCAN = true;     // when true, pressure and Vbat are captured in one SAADC session (every READ_VBAT_INTERVAL)
+const bool ADC_BURST_FILTER = true;     // when true, pressure is read as a short burst of samples reduced with trimmed mean, instead of 32x oversampling
+const bool ADC_ADAPTIVE_OVERSAMPLE = true;     // when true, pressure oversampling (burst length with ADC_BURST_FILTER) is adjusted to measured noise
+const uint8_t OVERSAMPLE_WINDOW = 16;     // number of readings used for one noise estimate
+const bool AUTONOMOUS_SAMPLING = false;     // when true, Sampling_engine samples pressure by RTC2 + PPI, CPU wakes up every SAMPLING_BATCH samples
+const uint8_t SAMPLING_BATCH = 4;     // number of samples (READ_INTERVAL apart) collected by Sampling_engine before CPU wakes up
+const bool RADIO_SYNC_SAMPLING = true;     // when true (and AUTONOMOUS_SAMPLING is false), readings falling on radio activity wait until it ends
+
 
 
 ///////////////////////////////////////////////// ADC CALIBRATION //////////////////////////////////////////////////////
 
-const int32_t TEMP_ADC_CALIBRATE = 750;     // = 7.5*C
+const int32_t TEMP_ADC_CALIBRATE = 750;     // = 7.5*C, initial threshold, before offset drift is learned
+const int16_t ADC_CAL_MIN_THRESHOLD = 200;     // = 2*C, learned threshold never goes below this
+const int16_t ADC_CAL_MAX_THRESHOLD = 2000;     // = 20*C, learned threshold never goes above this
+const int16_t ADC_CAL_ALLOWED_DRIFT = 2;     // offset drift (raw, = 1 LSB of a reading) tolerated between calibrations
+const uint8_t ADC_CAL_MAX_DEFERRALS = 5;     // calibration waits for radio idle window at most this many readings
 
 
 ///////////////////////////////////////////////// TIME INTERVALS ///////////////////////////////////////////////////////
 
 
-#define READ_INTERVAL 1000      // defines how often the sensor should read, advertise and display pressure
-#define READ_TIMER_INTERVAL APP_TIMER_TICKS(READ_INTERVAL)     // converts read interval to app timer ticks
-#define ADVERTISING_INTERVAL MSEC_TO_UNITS(READ_INTERVAL, UNIT_0_625_MS)     // converts read interval to adverting interval
-const uint8_t READ_VBAT_INTERVAL = 10;      // Vbat gets read every READ_INTERVAL * READ_VBAT_INTERVAL miliseconds
-const uint16_t SUPERVISE_ACC_INTERVAL = 3 * 60;    // Accelerometer gets supervised every 3 minutes
+#define READ_INTERVAL 1000      // defines how often the sensor should read pressure (initial reading task period)
+#define ADV_INTERVAL 1000      // defines how often the sensor should advertise (initial advertising task period)
+#define ADVERTISING_INTERVAL MSEC_TO_UNITS(ADV_INTERVAL, UNIT_0_625_MS)     // converts adv interval to adverting interval
+const bool ADAPTIVE_SAMPLING = true;     // when true, sampling interval is adjusted by main() samplingPolicy (policy below)
+const uint16_t SAMPLING_INTERVAL_FAST_MS = 250;     // after readings change or during alert
+const uint16_t SAMPLING_INTERVAL_PARKED_MS = 4000;     // readings stable for long
+const uint16_t SAMPLING_FAST_AFTER_CHANGE = 30;     // sample fast for this many seconds after pressure or temperature changed
+const uint16_t SAMPLING_PARKED_AFTER = 10 * 60;     // sample slowly, when readings haven't changed for this many seconds
+const bool ADAPTIVE_ADVERTISING = true;     // when true, advertising interval is adjusted by My_advertising::intervalPolicy (policy below)
+const uint16_t ADV_INTERVAL_FAST_MS = 500;     // after wake up and after readings change
+const uint16_t ADV_INTERVAL_SLOW_MS = 3000;     // readings stable
+const uint16_t ADV_INTERVAL_LOW_BAT_MS = 6000;     // readings stable and battery low
+const uint16_t ADV_FAST_AFTER_WAKE = 60;     // advertise fast for this many seconds after wake up
+const uint16_t ADV_FAST_AFTER_CHANGE = 30;     // advertise fast for this many seconds after pressure or temperature changed
+const uint8_t ADV_LOW_BAT_PERCENTAGE = 15;
+const uint32_t READ_VBAT_INTERVAL_MS = 10 * 1000;      // Vbat gets read every 10s
+const uint32_t SUPERVISE_ACC_INTERVAL_MS = 3 * 60 * 1000;    // Accelerometer gets supervised every 3 minutes
+const uint32_t TASK_SLACK_MS = SAMPLING_INTERVAL_PARKED_MS;     // battery, accelerometer, history and advertising tasks may wait this long, to run on a reading wake up
+const uint8_t SCHEDULER_QUEUE_SIZE = 5;     // app_scheduler events (one each from Task_scheduler, radio idle, Sampling_engine batch and History_service)
+const uint16_t LEAK_SAMPLE_INTERVAL = 60;      // pressure is sampled for leak detection every LEAK_SAMPLE_INTERVAL seconds
 
 };
 
@@ -13,18 +13,9 @@
  * Returns: char cointaining ascii code.
  */
 template <uint8_t in_byte>
-inline char upperHalfByteToAscii()
+constexpr char upperHalfByteToAscii()
 {
-	char p_in_byte = in_byte;
-    p_in_byte = p_in_byte >> 4;
-    if (p_in_byte <= 9)
-    {
-        return p_in_byte + '0';
-    }
-    else
-    {
-        return p_in_byte + 55;
-    }
+    return ((in_byte >> 4) <= 9) ? (char)((in_byte >> 4) + '0') : (char)((in_byte >> 4) + 55);
 }
 
 
@@ -35,18 +26,9 @@ inline char upperHalfByteToAscii()
  * Returns: char cointaining ascii code.
  */
 template <uint8_t in_byte>
-inline char lowerHalfByteToAscii()
+constexpr char lowerHalfByteToAscii()
 {
-	char p_in_byte = in_byte;
-    p_in_byte = p_in_byte & 0b00001111;
-    if (p_in_byte <= 9)
-    {
-        return p_in_byte + '0';
-    }
-    else
-    {
-        return p_in_byte + 55;
-    }
+    return ((in_byte & 0x0F) <= 9) ? (char)((in_byte & 0x0F) + '0') : (char)((in_byte & 0x0F) + 55);
 }
 
 
@@ -79,4 +61,49 @@ const T constrain(const T x, const T a, const T b) {
         return x;
 }
 
-#endif
\ No newline at end of file
+
+
+/*
+ * Function for sorting small arrays in place (insertion sort, ascending). Meant for a few tens of elements at most.
+ * Params: values - array to be sorted
+ *         count - number of elements
+ */
+template<class T>
+void sortSmall(T *values, uint8_t count)
+{
+    for (uint8_t i = 1; i < count; i++)
+    {
+        T value = values[i];
+        uint8_t j = i;
+        while (j > 0 && values[j - 1] > value)
+        {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+
+/*
+ * Function for calculating trimmed mean of samples. Samples get sorted, trim lowest and trim highest are dropped and 
+ * the rest is averaged. Spikes (for example from radio activity) don't affect the result, unlike with a plain average.
+ * With trim = (count - 1) / 2 it is a median.
+ * Params: values - samples (get sorted in place)
+ *         count - number of samples
+ *         trim - number of samples dropped from each end
+ * Returns: trimmed mean (rounded down)
+ */
+template<class T>
+T trimmedMean(T *values, uint8_t count, uint8_t trim)
+{
+    sortSmall(values, count);
+    int32_t sum = 0;
+    for (uint8_t i = trim; i < count - trim; i++)
+    {
+        sum += values[i];
+    }
+    return (T)(sum / (count - 2 * trim));
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "my_config.h"
 extern "C" 
 {
 #include "nrf_sdh.h"
@@ -12,8 +13,6 @@ extern "C"
 }
 
 
-#define APP_BLE_CONN_CFG_TAG 1 /**< A tag identifying the SoftDevice BLE configuration. */
-
 #define DEAD_BEEF 0xDEADBEEF /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
 
@@ -29,10 +28,7 @@ extern "C"
  * @param[in] line_num   Line number of the failing ASSERT call.
  * @param[in] file_name  File name of the failing ASSERT call.
  */
-void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
-{
-    app_error_handler(DEAD_BEEF, line_num, p_file_name);
-}
+void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name);     // defined in main.cpp, the header is included by more translation units
 
 
 
@@ -64,6 +60,29 @@ inline void bleStackInit()
 
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);      // Configure the BLE stack using the default settings.
     APP_ERROR_CHECK(err_code);
+
+    ble_cfg_t ble_cfg;
+    if (cfg::CONNECTABLE_HISTORY)     // deeper notification queue for history download
+    {
+        memset(&ble_cfg, 0, sizeof(ble_cfg));
+        ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+        ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = cfg::HISTORY_HVN_TX_QUEUE_SIZE;
+        err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+        APP_ERROR_CHECK(err_code);
+    }
+    else     // sdk_config.h is set up for history download, default ATT MTU and no vendor UUID keep SoftDevice RAM small
+    {
+        memset(&ble_cfg, 0, sizeof(ble_cfg));
+        ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+        ble_cfg.conn_cfg.params.gatt_conn_cfg.att_mtu = BLE_GATT_ATT_MTU_DEFAULT;
+        err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATT, &ble_cfg, ram_start);
+        APP_ERROR_CHECK(err_code);
+
+        memset(&ble_cfg, 0, sizeof(ble_cfg));
+        ble_cfg.common_cfg.vs_uuid_cfg.vs_uuid_count = 0;
+        err_code = sd_ble_cfg_set(BLE_COMMON_CFG_VS_UUID, &ble_cfg, ram_start);
+        APP_ERROR_CHECK(err_code);
+    }
     
     err_code = nrf_sdh_ble_enable(&ram_start);    // Enable BLE stack.
     APP_ERROR_CHECK(err_code);
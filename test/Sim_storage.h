@@ -0,0 +1,306 @@
+#ifndef SIM_STORAGE_H
+#define SIM_STORAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "fds.h"
+
+
+/*
+ * Flash simulated in RAM, with the methods of Fds_storage, so Flash_history runs on a host. It lays records out
+ * the way FDS does: FDS_VIRTUAL_PAGES pages of FDS_VIRTUAL_PAGE_SIZE words, one of them is the swap page. A page starts
+ * with a page tag, records follow one after another, each with a header. A new record goes to the first page with
+ * enough space. A removed record stays in flash (marked), until garbage collection copies the valid records of its
+ * page to the swap page, erases the page and makes it the new swap page.
+ *
+ * Operations are queued and carried out by complete(), like FDS carries them out later, so a block given to write()
+ * has to stay untouched until isBusy() returns false. Every programmed byte and every erase is counted, independently
+ * of the counting in Flash_history.
+ */
+class Sim_storage
+{
+    static const uint16_t PAGE_TAG_WORDS = 2;
+    static const uint16_t HEADER_WORDS = 3;     // record id, length, valid mark
+
+    enum Operation_type {WRITE, REMOVE, GC};
+
+    struct Operation
+    {
+        Operation_type type;
+        const uint32_t *p_words;
+        uint16_t length_words;
+        uint32_t record_id;
+        uint8_t page;
+    };
+
+    struct Page
+    {
+        uint32_t words[FDS_VIRTUAL_PAGE_SIZE];
+        uint16_t used;     // words written, page tag included
+        uint16_t reserved;     // words of queued writes
+    };
+
+    Page pages[FDS_VIRTUAL_PAGES];
+    uint8_t swap = FDS_VIRTUAL_PAGES - 1;
+    std::vector<Operation> queue;
+    uint32_t next_id = 1;
+    uint8_t find_page = 0;     // next() position
+    uint16_t find_offset = 0;
+
+    uint32_t programmed_bytes = 0;
+    uint32_t copied_bytes = 0;     // records copied by garbage collection
+    uint32_t erases = 0;
+
+
+    void erase(uint8_t p_page)
+    {
+        memset(pages[p_page].words, 0xFF, sizeof(pages[p_page].words));
+        pages[p_page].used = PAGE_TAG_WORDS;     // tagged right after erase
+        pages[p_page].reserved = 0;
+        programmed_bytes += PAGE_TAG_WORDS * 4;
+        erases++;
+    }
+
+
+    // Returns pointer to the header of a valid record, NULL if there is none with p_record_id.
+    uint32_t *find(uint32_t p_record_id)
+    {
+        for (uint8_t page = 0; page < FDS_VIRTUAL_PAGES; page++)
+        {
+            for (uint16_t offset = PAGE_TAG_WORDS; page != swap && offset < pages[page].used; offset += HEADER_WORDS + pages[page].words[offset + 1])
+            {
+                uint32_t *p_header = &pages[page].words[offset];
+                if (p_header[0] == p_record_id && p_header[2] != 0)
+                {
+                    return p_header;
+                }
+            }
+        }
+        return NULL;
+    }
+
+
+    // Returns true if a page holds removed records.
+    bool isDirty(uint8_t p_page)
+    {
+        for (uint16_t offset = PAGE_TAG_WORDS; offset < pages[p_page].used; offset += HEADER_WORDS + pages[p_page].words[offset + 1])
+        {
+            if (pages[p_page].words[offset + 2] == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    // Returns words of valid records in a page, headers included.
+    uint32_t validWords(uint8_t p_page)
+    {
+        uint32_t words = 0;
+        for (uint16_t offset = PAGE_TAG_WORDS; offset < pages[p_page].used; offset += HEADER_WORDS + pages[p_page].words[offset + 1])
+        {
+            if (pages[p_page].words[offset + 2] != 0)
+            {
+                words += HEADER_WORDS + pages[p_page].words[offset + 1];
+            }
+        }
+        return words;
+    }
+
+
+    void collect()
+    {
+        for (uint8_t page = 0; page < FDS_VIRTUAL_PAGES; page++)
+        {
+            if (page == swap || !isDirty(page))
+            {
+                continue;
+            }
+            Page &target = pages[swap];
+            for (uint16_t offset = PAGE_TAG_WORDS; offset < pages[page].used; offset += HEADER_WORDS + pages[page].words[offset + 1])
+            {
+                const uint32_t *p_header = &pages[page].words[offset];
+                if (p_header[2] != 0)
+                {
+                    const uint16_t words = HEADER_WORDS + p_header[1];
+                    memcpy(&target.words[target.used], p_header, words * 4);
+                    target.used += words;
+                    programmed_bytes += words * 4;
+                    copied_bytes += words * 4;
+                }
+            }
+            erase(page);
+            swap = page;
+        }
+    }
+
+  public:
+    static const uint32_t NO_SPACE = FDS_ERR_NO_SPACE_IN_FLASH;
+    static const uint8_t RECORD_HEADER_L = HEADER_WORDS * 4;
+    static const uint8_t RECORD_DELETE_L = 4;
+    static const uint16_t PAGE_WORDS = FDS_VIRTUAL_PAGE_SIZE - PAGE_TAG_WORDS;
+
+
+    Sim_storage()
+    {
+        for (uint8_t page = 0; page < FDS_VIRTUAL_PAGES; page++)
+        {
+            erase(page);
+        }
+        programmed_bytes = 0;     // formatted flash to start with
+        erases = 0;
+    }
+
+
+    uint32_t write(const uint32_t *p_words, uint16_t p_length_words, uint32_t &p_record_id)
+    {
+        const uint16_t words = HEADER_WORDS + p_length_words;
+        for (uint8_t page = 0; page < FDS_VIRTUAL_PAGES; page++)
+        {
+            if (page != swap && pages[page].used + pages[page].reserved + words <= FDS_VIRTUAL_PAGE_SIZE)
+            {
+                pages[page].reserved += words;
+                p_record_id = next_id++;
+                const Operation operation = {WRITE, p_words, p_length_words, p_record_id, page};
+                queue.push_back(operation);
+                return 0;
+            }
+        }
+        return NO_SPACE;
+    }
+
+
+    void remove(uint32_t p_record_id)
+    {
+        const Operation operation = {REMOVE, NULL, 0, p_record_id, 0};
+        queue.push_back(operation);
+    }
+
+
+    // Returns bytes the garbage collection will program, counted like Fds_storage counts them.
+    uint32_t collectGarbage()
+    {
+        uint32_t bytes = 0;
+        for (uint8_t page = 0; page < FDS_VIRTUAL_PAGES; page++)
+        {
+            if (page != swap && isDirty(page))
+            {
+                bytes += validWords(page) * 4 + PAGE_TAG_WORDS * 4;
+            }
+        }
+        const Operation operation = {GC, NULL, 0, 0, 0};
+        queue.push_back(operation);
+        return bytes;
+    }
+
+
+    bool isBusy()
+    {
+        return !queue.empty();
+    }
+
+
+    uint32_t getWriteErrors()
+    {
+        return 0;
+    }
+
+
+    const uint32_t *open(uint32_t p_record_id)
+    {
+        const uint32_t *p_header = find(p_record_id);
+        return (p_header == NULL) ? NULL : p_header + HEADER_WORDS;
+    }
+
+
+    void close(uint32_t p_record_id)
+    {
+    }
+
+
+    void rewind()
+    {
+        find_page = 0;
+        find_offset = PAGE_TAG_WORDS;
+    }
+
+
+    bool next(uint32_t &p_record_id)
+    {
+        for (; find_page < FDS_VIRTUAL_PAGES; find_page++, find_offset = PAGE_TAG_WORDS)
+        {
+            while (find_page != swap && find_offset < pages[find_page].used)
+            {
+                const uint32_t *p_header = &pages[find_page].words[find_offset];
+                find_offset += HEADER_WORDS + p_header[1];
+                if (p_header[2] != 0)
+                {
+                    p_record_id = p_header[0];
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    // Carries out all queued operations (FDS events).
+    void complete()
+    {
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const Operation &operation = queue[i];
+            if (operation.type == WRITE)
+            {
+                Page &page = pages[operation.page];
+                uint32_t *p_header = &page.words[page.used];
+                p_header[0] = operation.record_id;
+                p_header[1] = operation.length_words;
+                p_header[2] = 1;
+                memcpy(p_header + HEADER_WORDS, operation.p_words, operation.length_words * 4);
+                page.used += HEADER_WORDS + operation.length_words;
+                page.reserved -= HEADER_WORDS + operation.length_words;
+                programmed_bytes += (HEADER_WORDS + operation.length_words) * 4;
+            }
+            else if (operation.type == REMOVE)
+            {
+                uint32_t *p_header = find(operation.record_id);
+                if (p_header != NULL)
+                {
+                    p_header[2] = 0;
+                    programmed_bytes += RECORD_DELETE_L;
+                }
+            }
+            else
+            {
+                collect();
+            }
+        }
+        queue.clear();
+    }
+
+
+    // Returns bytes programmed since construction (records, removal marks, page tags, garbage collection copies).
+    uint32_t getProgrammedBytes()
+    {
+        return programmed_bytes;
+    }
+
+
+    // Returns bytes of records copied by garbage collection.
+    uint32_t getCopiedBytes()
+    {
+        return copied_bytes;
+    }
+
+
+    // Returns number of page erases.
+    uint32_t getErases()
+    {
+        return erases;
+    }
+};
+
+#endif
@@ -0,0 +1,376 @@
+#include "nrf_mock.h"
+#include "nrf_mock_control.h"
+
+
+NRF_SAADC_Type nrf_saadc_regs;
+
+namespace mock
+{
+int16_t (*saadc_input)(uint8_t p_channel) = NULL;
+uint32_t saadc_irqs = 0;
+uint32_t saadc_samples = 0;
+bool pins[32];
+bool dcdc_enabled = true;
+}
+
+extern "C" void SAADC_IRQHandler(void);
+
+
+
+void app_error_handler(uint32_t p_error_code, uint32_t p_line, const uint8_t *p_file_name)
+{
+    fprintf(stderr, "APP_ERROR 0x%lX at %s:%lu\n", (unsigned long)p_error_code, (const char *)p_file_name, (unsigned long)p_line);
+    abort();
+}
+
+
+
+// Returns average of inputs of all enabled channels.
+static int16_t scanAverage()
+{
+    int32_t sum = 0;
+    uint8_t channels = 0;
+    for (uint8_t ch = 0; ch < 8; ch++)
+    {
+        if (nrf_saadc_regs.CH[ch].PSELP != SAADC_CH_PSELP_PSELP_NC)
+        {
+            sum += (mock::saadc_input != NULL) ? mock::saadc_input(ch) : 0;
+            channels++;
+        }
+    }
+    return (int16_t)(sum / channels);
+}
+
+
+
+/*
+ * Runs SAADC tasks triggered since the last call and sets the events they produce. Conversions take no time,
+ * every enabled channel (PSELP connected) gives one result per SAMPLE task, taken from mock::saadc_input. Oversampling
+ * in scan mode without BURST mixes the channels, like the hardware does.
+ */
+static void saadcRunTasks()
+{
+    NRF_SAADC_Type &saadc = nrf_saadc_regs;
+    if (saadc.ENABLE == 0)
+    {
+        saadc.TASKS_START = saadc.TASKS_SAMPLE = saadc.TASKS_STOP = saadc.TASKS_CALIBRATEOFFSET = 0;
+        return;
+    }
+    if (saadc.TASKS_START)
+    {
+        saadc.TASKS_START = 0;
+        saadc.RESULT.AMOUNT = 0;
+        saadc.EVENTS_STARTED = 1;
+    }
+    const bool timers = ((saadc.SAMPLERATE & SAADC_SAMPLERATE_MODE_Msk) >> SAADC_SAMPLERATE_MODE_Pos) == SAADC_SAMPLERATE_MODE_Timers;
+    while (saadc.TASKS_SAMPLE)
+    {
+        saadc.TASKS_SAMPLE = timers ? 1 : 0;     // internal timer keeps sampling until the buffer is full
+        int16_t *p_buffer = (int16_t *)(uintptr_t)saadc.RESULT.PTR;
+        const bool oversample = (saadc.OVERSAMPLE & SAADC_OVERSAMPLE_OVERSAMPLE_Msk) != SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;
+        uint8_t channels = 0;
+        for (uint8_t ch = 0; ch < 8; ch++)
+        {
+            channels += (saadc.CH[ch].PSELP != SAADC_CH_PSELP_PSELP_NC);
+        }
+        for (uint8_t ch = 0; ch < 8 && saadc.RESULT.AMOUNT < saadc.RESULT.MAXCNT; ch++)
+        {
+            if (saadc.CH[ch].PSELP == SAADC_CH_PSELP_PSELP_NC)
+            {
+                continue;
+            }
+            int16_t value = (mock::saadc_input != NULL) ? mock::saadc_input(ch) : 0;
+            if (oversample && !(saadc.CH[ch].CONFIG & SAADC_CH_CONFIG_BURST_Msk) && channels > 1)
+            {
+                value = scanAverage();     // accumulator is shared, without burst it averages across channels
+            }
+            p_buffer[saadc.RESULT.AMOUNT++] = value;
+            mock::saadc_samples++;
+        }
+        if (saadc.RESULT.AMOUNT >= saadc.RESULT.MAXCNT)
+        {
+            saadc.TASKS_SAMPLE = 0;
+            saadc.EVENTS_END = 1;
+        }
+    }
+    if (saadc.TASKS_CALIBRATEOFFSET)
+    {
+        saadc.TASKS_CALIBRATEOFFSET = 0;
+        saadc.EVENTS_CALIBRATEDONE = 1;
+    }
+    if (saadc.TASKS_STOP)
+    {
+        saadc.TASKS_STOP = 0;
+        saadc.EVENTS_STOPPED = 1;
+    }
+}
+
+
+
+// Applies writes to INTENSET and INTENCLR (write-only registers) to INTEN.
+static void saadcApplyInten()
+{
+    NRF_SAADC_Type &saadc = nrf_saadc_regs;
+    saadc.INTEN = (saadc.INTEN | saadc.INTENSET) & ~saadc.INTENCLR;
+    saadc.INTENSET = saadc.INTENCLR = 0;
+}
+
+
+
+// Returns true if an enabled SAADC event is set (the interrupt is pending).
+static bool saadcIrqPending()
+{
+    NRF_SAADC_Type &saadc = nrf_saadc_regs;
+    return ((saadc.INTEN & SAADC_INTENSET_STARTED_Msk) && saadc.EVENTS_STARTED)
+           || ((saadc.INTEN & SAADC_INTENSET_END_Msk) && saadc.EVENTS_END)
+           || ((saadc.INTEN & SAADC_INTENSET_CALIBRATEDONE_Msk) && saadc.EVENTS_CALIBRATEDONE)
+           || ((saadc.INTEN & SAADC_INTENSET_STOPPED_Msk) && saadc.EVENTS_STOPPED);
+}
+
+
+
+// CPU sleep: peripherals run until an interrupt wakes CPU up, its handler runs and sleep returns.
+void nrf_pwr_mgmt_run(void)
+{
+    saadcApplyInten();
+    saadcRunTasks();
+    if (saadcIrqPending())
+    {
+        mock::saadc_irqs++;
+        SAADC_IRQHandler();
+        saadcApplyInten();     // before main context writes INTENSET again
+    }
+}
+
+
+
+void mock::saadcReset()
+{
+    memset(&nrf_saadc_regs, 0, sizeof(nrf_saadc_regs));
+    saadc_irqs = 0;
+    saadc_samples = 0;
+}
+
+
+
+ret_code_t nrf_pwr_mgmt_init(void) { return NRF_SUCCESS; }
+void nrf_gpio_cfg(uint32_t, nrf_gpio_pin_dir_t, nrf_gpio_pin_input_t, nrf_gpio_pin_pull_t, nrf_gpio_pin_drive_t, nrf_gpio_pin_sense_t) {}
+void nrf_gpio_pin_set(uint32_t p_pin) { mock::pins[p_pin] = true; }
+void nrf_gpio_pin_clear(uint32_t p_pin) { mock::pins[p_pin] = false; }
+uint32_t nrf_gpio_pin_read(uint32_t p_pin) { return mock::pins[p_pin]; }
+void nrf_delay_us(uint32_t) {}
+void nrf_delay_ms(uint32_t) {}
+uint32_t sd_power_dcdc_mode_set(uint8_t p_mode) { mock::dcdc_enabled = (p_mode == NRF_POWER_DCDC_ENABLE); return NRF_SUCCESS; }
+uint32_t sd_temp_get(int32_t *p_temp) { *p_temp = 25 * 4; return NRF_SUCCESS; }
+
+
+
+// the same CRC-16-CCITT as the SDK crc16 library
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size, uint16_t const *p_crc)
+{
+    uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+    return crc;
+}
+
+
+
+namespace mock
+{
+uint64_t rtc_ticks = 0;
+uint32_t timer_irqs = 0;
+}
+
+static const uint8_t MAX_TIMERS = 8;
+static app_timer_t *timers[MAX_TIMERS];
+static uint8_t timer_count = 0;
+
+static const uint8_t SCHED_MAX_QUEUE = 16;
+static const uint8_t SCHED_MAX_EVENT = 32;
+
+struct Sched_event
+{
+    app_sched_event_handler_t handler;
+    uint16_t size;
+    uint8_t data[SCHED_MAX_EVENT];
+};
+
+static Sched_event sched_queue[SCHED_MAX_QUEUE];
+static uint16_t sched_queue_size = 0;     // set by app_sched_init()
+static uint16_t sched_max_event_size = 0;
+static uint16_t sched_head = 0;
+static uint16_t sched_count = 0;
+
+
+
+ret_code_t app_timer_init(void) { return NRF_SUCCESS; }
+
+
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *p_timer = *p_timer_id;
+    p_timer->handler = timeout_handler;
+    p_timer->mode = mode;
+    p_timer->running = false;
+    for (uint8_t i = 0; i < timer_count; i++)
+    {
+        if (timers[i] == p_timer)
+        {
+            return NRF_SUCCESS;
+        }
+    }
+    APP_ERROR_CHECK_BOOL(timer_count < MAX_TIMERS);
+    timers[timer_count++] = p_timer;
+    return NRF_SUCCESS;
+}
+
+
+
+// the same limits as app_timer2.c
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS || timeout_ticks > APP_TIMER_MAX_CNT_VAL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    timer_id->p_context = p_context;
+    timer_id->period = timeout_ticks;
+    timer_id->expiry = mock::rtc_ticks + timeout_ticks;
+    timer_id->running = true;
+    return NRF_SUCCESS;
+}
+
+
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = false;
+    return NRF_SUCCESS;
+}
+
+
+
+uint32_t app_timer_cnt_get(void)
+{
+    return (uint32_t)(mock::rtc_ticks & APP_TIMER_MAX_CNT_VAL);
+}
+
+
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+
+
+uint32_t app_sched_init(uint16_t max_event_size, uint16_t queue_size, void *p_evt_buffer)
+{
+    APP_ERROR_CHECK_BOOL(max_event_size <= SCHED_MAX_EVENT && queue_size <= SCHED_MAX_QUEUE);
+    sched_max_event_size = max_event_size;
+    sched_queue_size = queue_size;
+    sched_head = sched_count = 0;
+    return NRF_SUCCESS;
+}
+
+
+
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+    if (event_size > sched_max_event_size)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (sched_count >= sched_queue_size)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    Sched_event &event = sched_queue[(sched_head + sched_count) % sched_queue_size];
+    event.handler = handler;
+    event.size = event_size;
+    if (p_event_data != NULL)
+    {
+        memcpy(event.data, p_event_data, event_size);
+    }
+    sched_count++;
+    return NRF_SUCCESS;
+}
+
+
+
+// Runs queued events, also those put by the handlers, until the queue is empty.
+void app_sched_execute(void)
+{
+    while (sched_count > 0)
+    {
+        Sched_event event = sched_queue[sched_head];
+        sched_head = (sched_head + 1) % sched_queue_size;
+        sched_count--;
+        event.handler(event.size ? event.data : NULL, event.size);
+    }
+}
+
+
+
+void mock::timerReset(uint64_t p_ticks)
+{
+    for (uint8_t i = 0; i < timer_count; i++)
+    {
+        timers[i]->running = false;
+    }
+    rtc_ticks = p_ticks;
+    timer_irqs = 0;
+    sched_head = sched_count = 0;
+}
+
+
+
+/*
+ * CPU sleep with app_timers running: advances rtc_ticks to the earliest expiry and runs the timeout handler, like
+ * the RTC1 interrupt does. Timers that expire together take one interrupt.
+ * Params: p_until - the sleep ends at this time at the latest [ticks]
+ * Returns: false if no timer expired by p_until (rtc_ticks is p_until then)
+ */
+bool mock::runTimers(uint64_t p_until)
+{
+    app_timer_t *p_next = NULL;
+    for (uint8_t i = 0; i < timer_count; i++)
+    {
+        if (timers[i]->running && (p_next == NULL || timers[i]->expiry < p_next->expiry))
+        {
+            p_next = timers[i];
+        }
+    }
+    if (p_next == NULL || p_next->expiry > p_until)
+    {
+        rtc_ticks = p_until;
+        return false;
+    }
+    rtc_ticks = p_next->expiry;
+    timer_irqs++;
+    for (uint8_t i = 0; i < timer_count; i++)
+    {
+        app_timer_t *p_timer = timers[i];
+        if (p_timer->running && p_timer->expiry == rtc_ticks)
+        {
+            if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+            {
+                p_timer->expiry += p_timer->period;
+            }
+            else
+            {
+                p_timer->running = false;
+            }
+            p_timer->handler(p_timer->p_context);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,229 @@
+#ifndef NRF_MOCK_H
+#define NRF_MOCK_H
+
+/*
+ * Host build replacement of the nRF5 SDK and SoftDevice headers used by the firmware sources. Only what the tested
+ * sources need is declared. Peripherals are plain structs in RAM, a test drives them (see nrf_mock.cpp).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {     // the firmware includes SDK headers inside extern "C", or without it
+
+////////////////////////////////////////////// common //////////////////////////////////////////////
+
+typedef uint32_t ret_code_t;
+#define NRF_SUCCESS 0
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_NOT_FOUND 5
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_BUSY 17
+#define NRF_ERROR_RESOURCES 19
+void app_error_handler(uint32_t p_error_code, uint32_t p_line, const uint8_t *p_file_name);
+#define APP_ERROR_CHECK(x) do { const uint32_t err_ = (x); if (err_ != NRF_SUCCESS) app_error_handler(err_, __LINE__, (const uint8_t *)__FILE__); } while (0)
+#define APP_ERROR_CHECK_BOOL(x) do { if (!(x)) app_error_handler(0, __LINE__, (const uint8_t *)__FILE__); } while (0)
+#define CONCAT_2(a, b) a##b
+#define MSEC_TO_UNITS(t, u) ((t) * 1000 / (u))
+#define UNIT_0_625_MS 625
+#define UNIT_1_25_MS 1250
+#define UNIT_10_MS 10000
+#define APP_IRQ_PRIORITY_HIGH 2
+#define APP_IRQ_PRIORITY_LOW 6
+#define APP_IRQ_PRIORITY_LOWEST 7
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT() }
+typedef enum { SAADC_IRQn, SWI1_EGU1_IRQn, RTC2_IRQn } IRQn_Type;
+#define SWI1_IRQn SWI1_EGU1_IRQn
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_ClearPendingIRQ(IRQn_Type) {}
+
+
+////////////////////////////////////////////// SAADC //////////////////////////////////////////////
+
+struct NRF_SAADC_Type
+{
+    volatile uint32_t TASKS_START, TASKS_SAMPLE, TASKS_STOP, TASKS_CALIBRATEOFFSET;
+    volatile uint32_t EVENTS_STARTED, EVENTS_END, EVENTS_DONE, EVENTS_RESULTDONE, EVENTS_CALIBRATEDONE, EVENTS_STOPPED;
+    struct { volatile uint32_t LIMITH, LIMITL; } EVENTS_CH[8];
+    volatile uint32_t INTEN, INTENSET, INTENCLR, STATUS, ENABLE;
+    struct { volatile uint32_t PSELP, PSELN, CONFIG, LIMIT; } CH[8];
+    volatile uint32_t RESOLUTION, OVERSAMPLE, SAMPLERATE;
+    struct { volatile uint32_t PTR, MAXCNT, AMOUNT; } RESULT;
+};
+extern NRF_SAADC_Type nrf_saadc_regs;
+#define NRF_SAADC (&nrf_saadc_regs)
+
+#define SAADC_ENABLE_ENABLE_Disabled 0
+#define SAADC_ENABLE_ENABLE_Enabled 1
+#define SAADC_ENABLE_ENABLE_Pos 0
+#define SAADC_RESOLUTION_VAL_8bit 0
+#define SAADC_RESOLUTION_VAL_10bit 1
+#define SAADC_RESOLUTION_VAL_12bit 2
+#define SAADC_RESOLUTION_VAL_14bit 3
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Bypass 0
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over2x 1
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over4x 2
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over8x 3
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over16x 4
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over32x 5
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over64x 6
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over128x 7
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Over256x 8
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Pos 0
+#define SAADC_OVERSAMPLE_OVERSAMPLE_Msk 0xFUL
+#define SAADC_CH_PSELP_PSELP_NC 0
+#define SAADC_CH_PSELP_PSELP_AnalogInput0 1
+#define SAADC_CH_PSELP_PSELP_AnalogInput2 3
+#define SAADC_CH_PSELP_PSELP_VDD 9
+#define SAADC_CH_CONFIG_RESP_Bypass 0
+#define SAADC_CH_CONFIG_RESP_Pos 0
+#define SAADC_CH_CONFIG_RESP_Msk 0x3UL
+#define SAADC_CH_CONFIG_RESN_Pos 4
+#define SAADC_CH_CONFIG_RESN_Msk 0x30UL
+#define SAADC_CH_CONFIG_GAIN_Gain1_6 0
+#define SAADC_CH_CONFIG_GAIN_Gain1 5
+#define SAADC_CH_CONFIG_GAIN_Gain4 7
+#define SAADC_CH_CONFIG_GAIN_Pos 8
+#define SAADC_CH_CONFIG_GAIN_Msk 0x700UL
+#define SAADC_CH_CONFIG_REFSEL_Internal 0
+#define SAADC_CH_CONFIG_REFSEL_VDD1_4 1
+#define SAADC_CH_CONFIG_REFSEL_Pos 12
+#define SAADC_CH_CONFIG_REFSEL_Msk 0x1000UL
+#define SAADC_CH_CONFIG_TACQ_3us 0
+#define SAADC_CH_CONFIG_TACQ_Pos 16
+#define SAADC_CH_CONFIG_TACQ_Msk 0x70000UL
+#define SAADC_CH_CONFIG_MODE_SE 0
+#define SAADC_CH_CONFIG_MODE_Diff 1
+#define SAADC_CH_CONFIG_MODE_Pos 20
+#define SAADC_CH_CONFIG_MODE_Msk 0x100000UL
+#define SAADC_CH_CONFIG_BURST_Disabled 0
+#define SAADC_CH_CONFIG_BURST_Enabled 1
+#define SAADC_CH_CONFIG_BURST_Pos 24
+#define SAADC_CH_CONFIG_BURST_Msk 0x1000000UL
+#define SAADC_SAMPLERATE_CC_Pos 0
+#define SAADC_SAMPLERATE_CC_Msk 0x7FFUL
+#define SAADC_SAMPLERATE_MODE_Task 0
+#define SAADC_SAMPLERATE_MODE_Timers 1
+#define SAADC_SAMPLERATE_MODE_Pos 12
+#define SAADC_SAMPLERATE_MODE_Msk 0x1000UL
+#define SAADC_INTENSET_STARTED_Msk 0x1UL
+#define SAADC_INTENSET_END_Msk 0x2UL
+#define SAADC_INTENSET_DONE_Msk 0x4UL
+#define SAADC_INTENSET_RESULTDONE_Msk 0x8UL
+#define SAADC_INTENSET_CALIBRATEDONE_Msk 0x10UL
+#define SAADC_INTENSET_STOPPED_Msk 0x20UL
+#define SAADC_INTENCLR_STARTED_Msk 0x1UL
+#define SAADC_INTENCLR_END_Msk 0x2UL
+#define SAADC_INTENCLR_DONE_Msk 0x4UL
+#define SAADC_INTENCLR_RESULTDONE_Msk 0x8UL
+#define SAADC_INTENCLR_CALIBRATEDONE_Msk 0x10UL
+#define SAADC_INTENCLR_STOPPED_Msk 0x20UL
+
+
+////////////////////////////////////////////// GPIO, delay, power //////////////////////////////////////////////
+
+typedef enum { NRF_GPIO_PIN_DIR_INPUT, NRF_GPIO_PIN_DIR_OUTPUT } nrf_gpio_pin_dir_t;
+typedef enum { NRF_GPIO_PIN_INPUT_CONNECT, NRF_GPIO_PIN_INPUT_DISCONNECT } nrf_gpio_pin_input_t;
+typedef enum { NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_PULLDOWN, NRF_GPIO_PIN_PULLUP } nrf_gpio_pin_pull_t;
+typedef enum { NRF_GPIO_PIN_S0S1, NRF_GPIO_PIN_H0H1, NRF_GPIO_PIN_S0H1 } nrf_gpio_pin_drive_t;
+typedef enum { NRF_GPIO_PIN_NOSENSE, NRF_GPIO_PIN_SENSE_LOW, NRF_GPIO_PIN_SENSE_HIGH } nrf_gpio_pin_sense_t;
+void nrf_gpio_cfg(uint32_t p_pin, nrf_gpio_pin_dir_t, nrf_gpio_pin_input_t, nrf_gpio_pin_pull_t, nrf_gpio_pin_drive_t, nrf_gpio_pin_sense_t);
+void nrf_gpio_pin_set(uint32_t p_pin);
+void nrf_gpio_pin_clear(uint32_t p_pin);
+uint32_t nrf_gpio_pin_read(uint32_t p_pin);
+void nrf_delay_us(uint32_t p_us);
+void nrf_delay_ms(uint32_t p_ms);
+
+ret_code_t nrf_pwr_mgmt_init(void);
+void nrf_pwr_mgmt_run(void);
+
+#define NRF_POWER_DCDC_DISABLE 0
+#define NRF_POWER_DCDC_ENABLE 1
+uint32_t sd_power_dcdc_mode_set(uint8_t p_mode);
+uint32_t sd_power_system_off(void);
+uint32_t sd_temp_get(int32_t *p_temp);
+
+
+////////////////////////////////////////////// SoftDevice, BLE //////////////////////////////////////////////
+
+ret_code_t nrf_sdh_enable_request(void);
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t p_conn_cfg_tag, uint32_t *p_ram_start);
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_ram_start);
+
+#define BLE_GAP_AD_TYPE_FLAGS 0x01
+#define BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME 0x09
+#define BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA 0xFF
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 0x06
+#define BLE_GAP_ADV_SET_DATA_SIZE_MAX 31
+#define BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED 255
+#define BLE_GATT_ATT_MTU_DEFAULT 23
+#define BLE_CONN_CFG_GATTS 0x24
+#define BLE_CONN_CFG_GATT 0x23
+#define BLE_COMMON_CFG_VS_UUID 0x01
+typedef struct { uint8_t hvn_tx_queue_size; } ble_gatts_conn_cfg_t;
+typedef struct { uint16_t att_mtu; } ble_gatt_conn_cfg_t;
+typedef struct { uint8_t conn_cfg_tag; union { ble_gatts_conn_cfg_t gatts_conn_cfg; ble_gatt_conn_cfg_t gatt_conn_cfg; } params; } ble_conn_cfg_t;
+typedef struct { uint8_t vs_uuid_count; } ble_common_cfg_vs_uuid_t;
+typedef union { ble_common_cfg_vs_uuid_t vs_uuid_cfg; } ble_common_cfg_t;
+typedef union { ble_conn_cfg_t conn_cfg; ble_common_cfg_t common_cfg; } ble_cfg_t;
+uint32_t sd_ble_cfg_set(uint32_t p_cfg_id, ble_cfg_t const *p_cfg, uint32_t p_ram_base);
+
+
+////////////////////////////////////////////// FDS //////////////////////////////////////////////
+
+#define FDS_VIRTUAL_PAGES 3
+#define FDS_VIRTUAL_PAGE_SIZE 1024     // [words]
+#define FDS_VIRTUAL_PAGES_RESERVED 0
+#define FDS_ERR_NO_SPACE_IN_FLASH 0x860B
+
+////////////////////////////////////////////// app_timer, app_scheduler //////////////////////////////////////////////
+
+// the same RTC1 setup as sdk_config.h (prescaler 1, 16384 Hz ticks) and the app_timer.h tick conversion
+#define APP_TIMER_CONFIG_RTC_FREQUENCY 1
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS 5
+#define APP_TIMER_MAX_CNT_VAL 0x00FFFFFF
+#define APP_TIMER_TICKS(MS) ((uint32_t)(((uint64_t)(MS) * APP_TIMER_CLOCK_FREQ + 500 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) \
+                                        / (1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))))
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+typedef enum { APP_TIMER_MODE_SINGLE_SHOT, APP_TIMER_MODE_REPEATED } app_timer_mode_t;
+typedef struct
+{
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t mode;
+    void *p_context;
+    uint32_t period;
+    uint64_t expiry;     // [ticks of mock::rtcTime()]
+    bool running;
+} app_timer_t;
+typedef app_timer_t *app_timer_id_t;
+#define APP_TIMER_DEF(timer_id) static app_timer_t CONCAT_2(timer_id, _data) = {}; static const app_timer_id_t timer_id = &CONCAT_2(timer_id, _data)
+ret_code_t app_timer_init(void);
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context);
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(void);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+#define APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE) APP_ERROR_CHECK(app_sched_init((EVENT_SIZE), (QUEUE_SIZE), NULL))
+uint32_t app_sched_init(uint16_t max_event_size, uint16_t queue_size, void *p_evt_buffer);
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+void app_sched_execute(void);
+
+////////////////////////////////////////////// CRC16 //////////////////////////////////////////////
+
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size, uint16_t const *p_crc);
+
+}
+
+#endif
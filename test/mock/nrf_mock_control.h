@@ -0,0 +1,26 @@
+#ifndef NRF_MOCK_CONTROL_H
+#define NRF_MOCK_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// State of the mocked peripherals, for tests to set inputs and check what the firmware did.
+namespace mock
+{
+extern int16_t (*saadc_input)(uint8_t p_channel);     // value converted on a channel, 0 if NULL
+extern uint32_t saadc_irqs;     // SAADC interrupts (CPU wake ups) since saadcReset()
+extern uint32_t saadc_samples;     // results written by EasyDMA since saadcReset()
+extern bool pins[32];     // GPIO output levels
+extern bool dcdc_enabled;
+
+void saadcReset();     // clears SAADC registers and counters
+
+extern uint64_t rtc_ticks;     // simulated time, RTC1 COUNTER is its low 24 bits [app_timer ticks]
+extern uint32_t timer_irqs;     // app_timer interrupts (CPU wake ups) since timerReset()
+
+void timerReset(uint64_t p_ticks);     // stops all app_timers, empties app_scheduler queue, sets rtc_ticks
+bool runTimers(uint64_t p_until);     // sleeps until the next app_timer expiry (false if none by p_until) and runs it
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * ADC with mocked NRF_SAADC: interrupt driven conversion sequence, results, bridge and DCDC handling.
+ */
+
+#include "ADC.h"
+#include "nrf_mock_control.h"
+#include "test_util.h"
+
+
+static const uint32_t BRIDGE_PIN = 16;
+
+// global, EasyDMA buffers are members and need 32 bit addresses
+static ADC<BRIDGE_PIN, SAADC_CH_PSELP_PSELP_AnalogInput0, SAADC_CH_PSELP_PSELP_AnalogInput2, false> adc;
+static ADC<BRIDGE_PIN, SAADC_CH_PSELP_PSELP_AnalogInput0, SAADC_CH_PSELP_PSELP_AnalogInput2, true> adc_scan;
+
+static int16_t pressure_input = 0;     // CH[0]
+static int16_t vbat_input = 0;     // CH[1] in scan mode
+static uint32_t spike_every = 0;     // every n-th CH[0] sample is a spike (0 - no spikes)
+static uint32_t ch0_samples = 0;
+static uint32_t done_calls = 0;
+
+
+
+static int16_t saadcInput(uint8_t p_channel)
+{
+    if (p_channel != 0)
+    {
+        return vbat_input;
+    }
+    ch0_samples++;
+    if (spike_every != 0 && ch0_samples % spike_every == 0)
+    {
+        return pressure_input + 400;
+    }
+    return pressure_input;
+}
+
+
+
+static void doneHandler(void)
+{
+    done_calls++;
+}
+
+
+
+// Resets the mock and the inputs before a test.
+static void reset(int16_t p_pressure, int16_t p_vbat = 0)
+{
+    mock::saadcReset();
+    mock::saadc_input = saadcInput;
+    pressure_input = p_pressure;
+    vbat_input = p_vbat;
+    spike_every = 0;
+    ch0_samples = 0;
+    done_calls = 0;
+}
+
+
+
+// Checks that the conversion left SAADC, bridge and DCDC as they should be between readings.
+static void checkIdle()
+{
+    CHECK(saadc_job.done);
+    CHECK_EQUAL(0, NRF_SAADC->ENABLE);
+    CHECK_EQUAL(0, NRF_SAADC->INTEN);
+    CHECK(!mock::pins[BRIDGE_PIN]);
+    CHECK(mock::dcdc_enabled);
+}
+
+
+
+static void testPressure()
+{
+    reset(1000);
+    CHECK_EQUAL(500, adc.analogReadPressure());     // noisy LSB removed
+    CHECK_EQUAL(3, mock::saadc_irqs);     // STARTED, END, STOPPED
+    checkIdle();
+
+    reset(-20);
+    CHECK_EQUAL(0, adc.analogReadPressure());     // negative readings are clamped
+}
+
+
+
+static void testAsyncPressure()
+{
+    reset(2000);
+    adc.startPressureConversion(doneHandler);
+    CHECK(!adc.isConversionDone());
+    CHECK(mock::pins[BRIDGE_PIN]);
+    CHECK(!mock::dcdc_enabled);     // off for the conversion
+    while (!adc.isConversionDone())
+    {
+        nrf_pwr_mgmt_run();
+    }
+    CHECK_EQUAL(1, done_calls);
+    CHECK_EQUAL(1000, adc.finishPressureConversion());
+    checkIdle();
+}
+
+
+
+static void testVbat()
+{
+    reset(0);
+    mock::saadc_input = NULL;     // CH[0] is Vbat here
+    CHECK_EQUAL(0, adc.analogReadVbat());
+    checkIdle();
+}
+
+
+
+static void testCalibration()
+{
+    reset(0);
+    adc.calibrate();
+    CHECK_EQUAL(2, mock::saadc_irqs);     // CALIBRATEDONE, STOPPED
+    CHECK_EQUAL(0, mock::saadc_samples);
+    checkIdle();
+
+    reset(0);
+    adc.startCalibration(doneHandler);
+    CHECK(!adc.isConversionDone());
+    while (!adc.isConversionDone())
+    {
+        nrf_pwr_mgmt_run();
+    }
+    adc.finishCalibration();
+    CHECK_EQUAL(1, done_calls);
+    checkIdle();
+}
+
+
+
+static void testBurst()
+{
+    reset(1000);
+    spike_every = 5;     // 3 spikes in 16 samples, trimmed
+    CHECK_EQUAL(500, adc.analogReadPressureBurst());
+    CHECK_EQUAL(16, mock::saadc_samples);     // default burst
+    checkIdle();
+
+    reset(1000);
+    adc.setPressureBurst(2);
+    CHECK_EQUAL(500, adc.analogReadPressureBurst());
+    CHECK_EQUAL(4, mock::saadc_samples);
+
+    reset(1000);
+    spike_every = 5;
+    adc.setPressureBurst(9);     // clamped to BURST_LOG2_MAX
+    CHECK_EQUAL(5, adc.getPressureBurst());
+    CHECK_EQUAL(500, adc.analogReadPressureBurst());
+    CHECK_EQUAL(32, mock::saadc_samples);
+    adc.setPressureBurst(4);
+}
+
+
+
+static void testCombinedScan()
+{
+    reset(1000, 2000);
+    uint16_t pressure_raw = 0;
+    uint16_t vbat_raw = 0;
+    adc_scan.analogReadPressureAndVbat(pressure_raw, vbat_raw);
+    CHECK_EQUAL(500, pressure_raw);
+    CHECK_EQUAL(2000 >> 4, vbat_raw);     // 12 bit -> 8 bit
+    checkIdle();
+    CHECK_EQUAL(3, mock::saadc_irqs);     // one scan, the same wake ups as a single pressure reading
+    CHECK_EQUAL(2, mock::saadc_samples);
+
+    reset(1000, 2000);
+    adc.analogReadPressureAndVbat(pressure_raw, vbat_raw);     // two sessions
+    CHECK_EQUAL(500, pressure_raw);
+    checkIdle();
+}
+
+
+
+int main()
+{
+    testPressure();
+    testAsyncPressure();
+    testVbat();
+    testCalibration();
+    testBurst();
+    testCombinedScan();
+    return testResult("test_adc");
+}
@@ -0,0 +1,132 @@
+/*
+ * Calibration_table: accuracy against the linear fit, factory table validation, and a benchmark
+ * of the interpolation kernel against map() (host time, only relative numbers mean something).
+ */
+
+#include "Calibration_table.h"
+#include "mapper.h"
+#include "test_util.h"
+#include <chrono>
+#include <string.h>
+
+
+static const uint16_t TABLE_MAX_RAW = cfg::CAL_RAW_MIN + ((cfg::CAL_RAW_POINTS - 1) << cfg::CAL_RAW_STEP_SHIFT);
+
+static Cal_flash_image image;     // factory table, as the programmer writes it
+static Calibration_table cal_table;
+
+
+
+// Fills image with the table from my_config.h plus p_offset_dkPa, with valid magic and crc.
+static void makeImage(int16_t p_offset_dkPa)
+{
+    image.magic = CAL_FLASH_MAGIC;
+    image.id = 7;
+    for (uint8_t row = 0; row < cfg::CAL_TEMP_POINTS; row++)
+    {
+        for (uint8_t column = 0; column < cfg::CAL_RAW_POINTS; column++)
+        {
+            image.table[row][column] = cfg::CAL_TABLE_DKPA[row][column] + p_offset_dkPa;
+        }
+    }
+    image.crc = crc16_compute((const uint8_t *)&image.id, sizeof(image.id), NULL);
+    image.crc = crc16_compute((const uint8_t *)image.table, sizeof(image.table), &image.crc);
+}
+
+
+
+static void testDefault()
+{
+    Calibration_table table;
+    CHECK_EQUAL(cfg::CAL_TABLE_MAPPING, table.isUsed());     // linear fit, unless configured or a factory table is loaded
+    CHECK_EQUAL(0, table.getId());
+}
+
+
+
+// The default table is the linear fit, so it has to map the same as map() over its raw range, at any temperature.
+static void testAccuracy()
+{
+    int32_t max_error = 0;
+    for (int32_t temperature = -4000; temperature <= 9000; temperature += 500)
+    {
+        for (uint16_t raw = 0; raw <= TABLE_MAX_RAW; raw++)
+        {
+            const int32_t error = (int32_t)cal_table.map(raw, temperature) - map(raw);
+            max_error = (error < 0 && -error > max_error) ? -error : (error > max_error ? error : max_error);
+        }
+    }
+    printf("Calibration_table::map(): max difference from map() %ld kPa over raw 0-%u\n", (long)max_error, TABLE_MAX_RAW);
+    CHECK(max_error <= 1);
+    CHECK_EQUAL(cal_table.map(TABLE_MAX_RAW, 2500), cal_table.map(MAP_MAX_RAW, 2500));     // clamped to the table edge
+}
+
+
+
+static void testLoad()
+{
+    Calibration_table table;
+    makeImage(100);
+    image.magic = 0xFFFFFFFF;     // erased flash
+    CHECK(!table.load(&image));
+
+    makeImage(100);
+    image.table[1][3]++;     // corrupted after crc
+    CHECK(!table.load(&image));
+
+    makeImage(100);
+    image.table[2][4] = image.table[2][3];     // not increasing, crc is right
+    image.crc = crc16_compute((const uint8_t *)&image.id, sizeof(image.id), NULL);
+    image.crc = crc16_compute((const uint8_t *)image.table, sizeof(image.table), &image.crc);
+    CHECK(!table.load(&image));
+    CHECK(!table.isUsed() || cfg::CAL_TABLE_MAPPING);
+    CHECK_EQUAL(0, table.getId());
+    CHECK_EQUAL(cal_table.map(1000, 2500), table.map(1000, 2500));     // still the table from my_config.h
+
+    makeImage(100);     // +10kPa
+    CHECK(table.load(&image));
+    CHECK(table.isUsed());
+    CHECK_EQUAL(7, table.getId());
+    CHECK_EQUAL(cal_table.map(1000, 2500) + 10, table.map(1000, 2500));
+}
+
+
+
+// Times p_function over the raw range at a few temperatures. Returns: [ns per call]
+template <class Function>
+static double benchmark(Function p_function)
+{
+    static const uint32_t ROUNDS = 200;
+    volatile uint32_t sink = 0;     // keeps the calls from being optimized out
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        const int32_t temperature = -2000 + (int32_t)(round % 10) * 1000;
+        for (uint16_t raw = 0; raw <= MAP_MAX_RAW; raw++)
+        {
+            sink = sink + p_function(raw, temperature);
+        }
+    }
+    const auto time = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(time).count() / (ROUNDS * (MAP_MAX_RAW + 1));
+}
+
+
+
+static void benchmarkMap()
+{
+    const double table_ns = benchmark([](uint16_t p_raw, int32_t p_temperature) { return cal_table.map(p_raw, p_temperature); });
+    const double linear_ns = benchmark([](uint16_t p_raw, int32_t) { return map(p_raw); });
+    printf("benchmark: Calibration_table::map() %.1f ns, map() %.1f ns per reading (host)\n", table_ns, linear_ns);
+}
+
+
+
+int main()
+{
+    testDefault();
+    testAccuracy();
+    testLoad();
+    benchmarkMap();
+    return testResult("test_calibration");
+}
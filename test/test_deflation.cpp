@@ -0,0 +1,86 @@
+/*
+ * Deflation_detector at the sampling intervals samplingPolicy() uses: time to alert after a pressure drop, alert hold,
+ * and no alert on reading noise. All of them must not depend on the sampling interval.
+ */
+
+#include "Deflation_detector.h"
+#include "my_config.h"
+#include "test_util.h"
+#include <stdlib.h>
+
+
+typedef Deflation_detector<cfg::DEFLATION_DRIFT_KPA, cfg::DEFLATION_THRESHOLD_KPA_S, cfg::DEFLATION_ALERT_HOLD_MS> Detector;
+
+static const uint16_t PRESSURE_KPA = 230;
+static const uint32_t INTERVALS_MS[] = {cfg::SAMPLING_INTERVAL_FAST_MS, READ_INTERVAL, cfg::SAMPLING_INTERVAL_PARKED_MS};
+
+
+
+// Returns a reading with noise of up to +-p_noise_kPa.
+static uint16_t noisy(uint16_t p_pressure_kPa, int32_t p_noise_kPa)
+{
+    return (uint16_t)(p_pressure_kPa + rand() % (2 * p_noise_kPa + 1) - p_noise_kPa);
+}
+
+
+
+/*
+ * A 12 kPa drop raises the alert after ~THRESHOLD_KPA_S / (12 - DRIFT_KPA) = 2 s at any interval up to a second.
+ * At longer intervals every reading weighs a second.
+ */
+static void testDrop()
+{
+    for (uint32_t interval_ms : INTERVALS_MS)
+    {
+        Detector detector(PRESSURE_KPA);
+        for (uint32_t t = 0; t < 60 * 1000; t += interval_ms)
+        {
+            CHECK(!detector.update(PRESSURE_KPA, interval_ms));
+        }
+        uint32_t alert_ms = 0;
+        while (!detector.update(PRESSURE_KPA - 12, interval_ms))
+        {
+            alert_ms += interval_ms;
+            CHECK(alert_ms < 10 * 1000);
+        }
+        alert_ms += interval_ms;
+        const uint32_t weight_ms = (interval_ms < 1000) ? interval_ms : 1000;
+        const uint32_t readings = cfg::DEFLATION_THRESHOLD_KPA_S * 1000 / ((12 - cfg::DEFLATION_DRIFT_KPA) * weight_ms) + 1;
+        CHECK_EQUAL(readings * interval_ms, alert_ms);
+        CHECK(detector.isAlert());
+
+        // held DEFLATION_ALERT_HOLD_MS after the drop stops (the pressure stays at the new level)
+        uint32_t hold_ms = 0;
+        while (detector.isAlert())
+        {
+            CHECK(!detector.update(PRESSURE_KPA - 12, interval_ms));
+            hold_ms += interval_ms;
+        }
+        CHECK(hold_ms >= cfg::DEFLATION_ALERT_HOLD_MS && hold_ms < cfg::DEFLATION_ALERT_HOLD_MS + interval_ms);
+    }
+}
+
+
+
+// Reading noise of +-2 kPa doesn't raise an alert in an hour.
+static void testNoise()
+{
+    srand(1);
+    for (uint32_t interval_ms : INTERVALS_MS)
+    {
+        Detector detector(PRESSURE_KPA);
+        for (uint32_t t = 0; t < 60 * 60 * 1000; t += interval_ms)
+        {
+            CHECK(!detector.update(noisy(PRESSURE_KPA, 2), interval_ms));
+        }
+    }
+}
+
+
+
+int main()
+{
+    testDrop();
+    testNoise();
+    return testResult("test_deflation");
+}
@@ -0,0 +1,151 @@
+/*
+ * Flash_history on simulated FDS flash (Sim_storage): records read back, index rebuilt after a restart, and flash
+ * bytes counted by Flash_history against bytes the simulation programmed. Prints write amplification.
+ */
+
+#include "Flash_history.h"
+#include "Sim_storage.h"
+#include "my_config.h"
+#include "test_util.h"
+#include <stdlib.h>
+
+
+typedef Flash_history<cfg::HISTORY_BLOCK_WORDS, cfg::HISTORY_MAX_BLOCKS, Sim_storage> History;
+
+static const uint32_t RECORDS = 20000;
+
+// globals, too big for the stack
+static Sim_storage storage;
+static History_record expected[2 * RECORDS];     // everything added, by sequence number
+static History_record records[1024];
+
+
+
+// Simulated readings: pressure drifts by a kPa now and then, temperature by a few 1/100 *C, with occasional jumps.
+static History_record reading(uint32_t p_sequence)
+{
+    static int32_t pressure = 230;
+    static int32_t temperature = 2000;
+    if (rand() % 8 == 0)
+    {
+        pressure += rand() % 3 - 1;
+    }
+    temperature += rand() % 21 - 10;
+    if (p_sequence % 3000 == 0)
+    {
+        temperature += 500;     // driving after parking
+    }
+    History_record record = {(uint16_t)pressure, (int16_t)temperature};
+    return record;
+}
+
+
+
+// Adds p_count records, running service() and the storage like the main loop and FDS events do.
+static void addRecords(History &p_history, uint32_t p_first, uint32_t p_count)
+{
+    for (uint32_t sequence = p_first; sequence < p_first + p_count; sequence++)
+    {
+        expected[sequence] = reading(sequence);
+        p_history.add(expected[sequence].pressure, expected[sequence].temperature);
+        p_history.service();
+        storage.complete();
+    }
+}
+
+
+
+// Reads everything kept and compares it to what was added. Returns: sequence number of the oldest record kept
+static uint32_t checkRecords(History &p_history, uint32_t p_total)
+{
+    uint32_t sequence = 0;
+    uint16_t count = p_history.read(sequence, records, 1024);
+    const uint32_t oldest = sequence;
+    CHECK(count > 0);
+    while (count > 0)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            CHECK_EQUAL(expected[sequence + i].pressure, records[i].pressure);
+            CHECK_EQUAL(expected[sequence + i].temperature, records[i].temperature);
+        }
+        sequence += count;
+        count = p_history.read(sequence, records, 1024);
+    }
+    CHECK_EQUAL(p_total, sequence);     // nothing missing up to the newest record
+    return oldest;
+}
+
+
+
+static void printStats(const char *p_name, History &p_history)
+{
+    const Flash_history_stats &stats = p_history.getStats();
+    printf("%s: %lu records, %lu blocks written, %lu removed, %lu gc, write amplification %lu.%03lu "
+           "(%lu flash bytes, %lu of them gc copies, %lu sample bytes), %lu page erases\n",
+           p_name, (unsigned long)stats.samples, (unsigned long)stats.blocks_written, (unsigned long)stats.blocks_removed,
+           (unsigned long)stats.gc_runs, (unsigned long)(p_history.getWriteAmplification() / 1000),
+           (unsigned long)(p_history.getWriteAmplification() % 1000), (unsigned long)stats.flash_bytes,
+           (unsigned long)stats.gc_bytes, (unsigned long)stats.sample_bytes, (unsigned long)storage.getErases());
+}
+
+
+
+// The same history object runs all the time (no System OFF).
+static History history(storage);
+
+static void testWriteAmplification()
+{
+    addRecords(history, 0, RECORDS);
+    const uint32_t oldest = checkRecords(history, RECORDS);
+    printStats("continuous", history);
+    printf("continuous: %lu records kept\n", (unsigned long)(RECORDS - oldest));
+
+    const Flash_history_stats &stats = history.getStats();
+    CHECK_EQUAL(storage.getProgrammedBytes(), stats.flash_bytes);     // every programmed byte is counted
+    CHECK_EQUAL(0, storage.getCopiedBytes());     // full blocks fill pages exactly, removed pages hold nothing valid
+    CHECK_EQUAL(0, stats.dropped);
+    CHECK(history.getWriteAmplification() < 600);
+}
+
+
+
+// Partial blocks are flushed before System OFF, then history is loaded again from flash.
+static History restarted(storage);
+
+static void testRestart()
+{
+    uint32_t total = RECORDS;
+    while (!history.flush())
+    {
+        storage.complete();
+    }
+    const uint32_t programmed = storage.getProgrammedBytes();
+
+    restarted.load();
+    checkRecords(restarted, total);
+    for (uint8_t restart = 0; restart < 20; restart++)     // short rides with a System OFF after each
+    {
+        const uint32_t ride = 150 + restart * 37;
+        addRecords(restarted, total, ride);
+        total += ride;
+        while (!restarted.flush())
+        {
+            storage.complete();
+        }
+    }
+    checkRecords(restarted, total);
+    printStats("with restarts", restarted);
+    CHECK_EQUAL(storage.getProgrammedBytes() - programmed, restarted.getStats().flash_bytes);     // gc copies counted too
+    printf("with restarts: %lu bytes copied by gc\n", (unsigned long)storage.getCopiedBytes());
+}
+
+
+
+int main()
+{
+    srand(1);
+    testWriteAmplification();
+    testRestart();
+    return testResult("test_flash_history");
+}
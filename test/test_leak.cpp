@@ -0,0 +1,129 @@
+/*
+ * Leak_detector fed like in main(): noisy readings every READ_INTERVAL go through Measurments, the filtered pressure is
+ * sampled every LEAK_SAMPLE_INTERVAL. A steady tire must not be reported as leaking and must not update advertising
+ * on every sample, a slow leak must be reported.
+ */
+
+#include "Leak_detector.h"
+#include "measurments.h"
+#include "my_config.h"
+#include "test_util.h"
+#include <stdlib.h>
+
+
+typedef Leak_detector<cfg::LEAK_WINDOW, cfg::LEAK_SAMPLE_INTERVAL, cfg::LEAK_RATE_THRESHOLD> Detector;
+typedef Measurments<cfg::PRESSURE_SENSITIVITY_KPA, cfg::TEMP_SENSITIVITY, cfg::TEMP_ADC_CALIBRATE, cfg::PRESSURE_PROCESS_NOISE,
+                    cfg::PRESSURE_MEASUREMENT_NOISE, cfg::TEMP_PROCESS_NOISE, cfg::TEMP_MEASUREMENT_NOISE> Readings;
+
+static const uint16_t PRESSURE_KPA = 230;
+static const int16_t TEMPERATURE = 2000;     // 20*C
+static const uint32_t SIMULATED_S = 4 * 60 * 60;
+static const uint32_t SAMPLES = SIMULATED_S / cfg::LEAK_SAMPLE_INTERVAL;
+
+
+
+struct Result
+{
+    uint32_t changes;     // addSample() returned true
+    uint32_t leaking_samples;
+    uint32_t first_leaking_s;
+};
+
+
+
+// Runs SIMULATED_S of readings with +-2 kPa noise, pressure drops by p_leak_dkPa_h [0.1kPa/h].
+static Result simulate(int32_t p_leak_dkPa_h)
+{
+    srand(1);
+    Readings readings(PRESSURE_KPA, TEMPERATURE, 100);
+    Detector detector;
+    Result result = Result();
+    uint32_t leak_sample_ms = 0;
+    for (uint32_t t_ms = READ_INTERVAL; t_ms <= SIMULATED_S * 1000; t_ms += READ_INTERVAL)
+    {
+        const int32_t pressure_dkPa = PRESSURE_KPA * 10 - (int32_t)((int64_t)p_leak_dkPa_h * t_ms / 3600000);
+        const uint16_t pressure_kPa = (uint16_t)((pressure_dkPa + 5) / 10 + rand() % 5 - 2);
+        readings.checkForChanges(pressure_kPa, TEMPERATURE, 100);
+        leak_sample_ms += READ_INTERVAL;
+        if (leak_sample_ms >= cfg::LEAK_SAMPLE_INTERVAL * 1000UL)
+        {
+            leak_sample_ms = 0;
+            if (detector.addSample(readings.getFilteredPressure(), readings.getFilteredTemperature()))
+            {
+                result.changes++;
+            }
+            if (detector.isLeaking())
+            {
+                if (result.leaking_samples == 0)
+                {
+                    result.first_leaking_s = t_ms / 1000;
+                }
+                result.leaking_samples++;
+            }
+        }
+    }
+    printf("leak %ld x0.1kPa/h: %lu changes in %lu samples, leaking in %lu samples, first after %lu s\n",
+           (long)p_leak_dkPa_h, (unsigned long)result.changes, (unsigned long)SAMPLES,
+           (unsigned long)result.leaking_samples, (unsigned long)result.first_leaking_s);
+    return result;
+}
+
+
+
+// A steady tire is never leaking, and the rate is reported far less often than it's sampled.
+static void testSteady()
+{
+    Result result = simulate(0);
+    CHECK_EQUAL(0, result.leaking_samples);
+    CHECK(result.changes < SAMPLES / 10);
+}
+
+
+
+// A leak twice the threshold is reported within two windows and stays reported.
+static void testLeak()
+{
+    Result result = simulate(2 * cfg::LEAK_RATE_THRESHOLD);
+    CHECK(result.leaking_samples > 0);
+    CHECK(result.first_leaking_s <= 2 * cfg::LEAK_WINDOW * cfg::LEAK_SAMPLE_INTERVAL);
+    CHECK(result.leaking_samples > SAMPLES * 3 / 4);
+    CHECK(result.changes < SAMPLES / 10);
+}
+
+
+
+// Sums and deadband: a rate reported once isn't reported again until it moves by LEAK_RATE_THRESHOLD / 2.
+static void testDeadband()
+{
+    Detector detector;
+    for (uint8_t i = 0; i < cfg::LEAK_WINDOW - 1; i++)
+    {
+        CHECK(!detector.addSample(PRESSURE_KPA, TEMPERATURE));
+    }
+    CHECK(!detector.addSample(PRESSURE_KPA, TEMPERATURE));     // window full, rate 0 as before
+    CHECK_EQUAL(0, detector.getRate());
+    CHECK(!detector.addSample(PRESSURE_KPA + 1, TEMPERATURE));     // slope below the deadband
+    CHECK_EQUAL(0, detector.getRate());
+
+    // one sample of a steady drop of 1 kPa per sample (60 kPa/h) changes the slope enough
+    Detector falling;
+    bool changed = false;
+    for (uint8_t i = 0; i < cfg::LEAK_WINDOW; i++)
+    {
+        changed = falling.addSample(PRESSURE_KPA - i, TEMPERATURE);
+    }
+    CHECK(changed);
+    CHECK(falling.isLeaking());
+    CHECK_EQUAL(-600, falling.getRate());
+    CHECK(!falling.addSample(PRESSURE_KPA - cfg::LEAK_WINDOW, TEMPERATURE));     // same slope, nothing to report
+}
+
+
+
+int main()
+{
+    testSteady();
+    testLeak();
+    testDeadband();
+    return testResult("test_leak");
+}
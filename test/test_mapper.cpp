@@ -0,0 +1,63 @@
+/*
+ * Fixed point map() against the float formula it replaced, over the full raw pressure range.
+ */
+
+#include "mapper.h"
+#include "test_util.h"
+#include <math.h>
+
+
+// map() before fixed point coefficients (float multiply-add, cast truncates toward zero)
+static uint16_t floatMap(uint16_t p_pressure)
+{
+    int32_t result = (int32_t)((float)p_pressure * cfg::A_COEFFICIENT + cfg::B_COEFFICIENT);
+    if (result < 20)
+        result = 0;
+    return (uint16_t)result;
+}
+
+
+
+static void testMap()
+{
+    double max_error = 0;     // fixed point value before rounding against exact a * pressure + b [kPa]
+    uint32_t max_error_raw = 0;
+    uint32_t differences = 0;     // raw readings mapped to a different kPa than the float formula
+    for (uint32_t raw = 0; raw <= MAP_MAX_RAW; raw++)
+    {
+        const double fixed = ((double)raw * A_FIXED + B_FIXED) / (1 << MAP_FRACTION_BITS);
+        const double exact = (double)raw * cfg::A_COEFFICIENT + cfg::B_COEFFICIENT;
+        if (fabs(fixed - exact) > max_error)
+        {
+            max_error = fabs(fixed - exact);
+            max_error_raw = raw;
+        }
+        const int32_t difference = (int32_t)map(raw) - floatMap(raw);
+        CHECK(difference >= -1 && difference <= 1);
+        differences += (difference != 0);
+    }
+    printf("map(): max error %.5f kPa (raw %lu), %lu of %u readings differ by 1 kPa from float\n",
+           max_error, (unsigned long)max_error_raw, (unsigned long)differences, MAP_MAX_RAW + 1);
+    CHECK(max_error < 0.05);
+    CHECK(differences <= (MAP_MAX_RAW + 1) / 100);     // only readings within max_error of a kPa boundary
+}
+
+
+
+static void testNegative()
+{
+    // below ~38 raw the intermediate is negative: rounding toward zero, then constrained to 0
+    for (uint16_t raw = 0; raw < 40; raw++)
+    {
+        CHECK_EQUAL(floatMap(raw), map(raw));
+    }
+}
+
+
+
+int main()
+{
+    testMap();
+    testNegative();
+    return testResult("test_mapper");
+}
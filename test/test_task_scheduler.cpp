@@ -0,0 +1,259 @@
+/*
+ * Task_scheduler on a simulated RTC (mocked app_timer and app_scheduler): the tasks of main() over 600 s across the
+ * 24 bit counter wrap around, wake ups shared by tasks with slack, elapsed time given to handlers, setPeriod(), trigger()
+ * and periods longer than the longest timer sleep.
+ */
+
+#include "Task_scheduler.h"
+#include "my_config.h"
+#include "nrf_mock_control.h"
+#include "test_util.h"
+
+
+static const uint64_t TICKS_PER_SECOND = 16384;     // RTC1 with prescaler 1 (sdk_config.h)
+static const uint32_t SIMULATED_S = 600;
+
+// What a task did, checked against its own schedule (the due time advances by the period, like in Task_scheduler).
+struct Task_log
+{
+    uint32_t period_ms;
+    uint32_t slack_ms;
+    uint64_t due;     // [ticks]
+    uint64_t last_run;     // [ticks]
+    uint32_t runs;
+    uint32_t last_run_irq;     // mock::timer_irqs at the last run
+    uint32_t max_late_ms;
+    uint64_t elapsed_ms_sum;
+    bool (*trigger_on_run)(uint32_t p_runs);     // when it returns true, the handler triggers triggered_task
+};
+
+static Task_scheduler<5> *p_scheduler = NULL;
+static uint8_t triggered_task = 0;
+static Task_log *p_triggered_log = NULL;
+
+
+
+static uint64_t msToTicks(uint32_t p_ms)
+{
+    return p_ms * TICKS_PER_SECOND / 1000;
+}
+
+
+
+// Starts a log of a task added now.
+static void startLog(Task_log &p_log, uint32_t p_period_ms, uint32_t p_slack_ms = 0)
+{
+    p_log = Task_log();
+    p_log.period_ms = p_period_ms;
+    p_log.slack_ms = p_slack_ms;
+    p_log.last_run = mock::rtc_ticks;
+    p_log.due = mock::rtc_ticks + msToTicks(p_period_ms);
+}
+
+
+
+static void taskHandler(void *p_context, uint32_t p_elapsed_ms)
+{
+    Task_log &log = *(Task_log *)p_context;
+    const uint64_t now = mock::rtc_ticks;
+    CHECK(now >= log.due);
+    const uint32_t late_ms = (now - log.due) * 1000 / TICKS_PER_SECOND;
+    CHECK(late_ms <= log.slack_ms);
+    if (late_ms > log.max_late_ms)
+    {
+        log.max_late_ms = late_ms;
+    }
+    CHECK_EQUAL((now - log.last_run) * 1000 / TICKS_PER_SECOND, p_elapsed_ms);
+    log.elapsed_ms_sum += p_elapsed_ms;
+    log.due += msToTicks(log.period_ms);
+    if (log.due <= now)
+    {
+        log.due = now + msToTicks(log.period_ms);
+    }
+    log.last_run = now;
+    log.last_run_irq = mock::timer_irqs;
+    log.runs++;
+    if (log.trigger_on_run != NULL && log.trigger_on_run(log.runs))
+    {
+        p_scheduler->trigger(triggered_task);
+        p_triggered_log->due = now;
+    }
+}
+
+
+
+// main() loop: sleep until the timer interrupt, then run the scheduled events.
+static void runFor(uint32_t p_seconds)
+{
+    const uint64_t until = mock::rtc_ticks + p_seconds * TICKS_PER_SECOND;
+    while (mock::runTimers(until))
+    {
+        app_sched_execute();
+    }
+}
+
+
+
+// Sets up the simulation, the RTC counter wraps around p_wrap_in_s after the start.
+static void reset(uint32_t p_wrap_in_s)
+{
+    mock::timerReset(APP_TIMER_MAX_CNT_VAL + 1 - p_wrap_in_s * TICKS_PER_SECOND);
+    APP_SCHED_INIT(sizeof(void *), cfg::SCHEDULER_QUEUE_SIZE);
+}
+
+
+
+static bool everyTime(uint32_t p_runs)
+{
+    return true;
+}
+
+
+
+static bool fifthTime(uint32_t p_runs)
+{
+    return p_runs == 5;
+}
+
+
+
+/*
+ * The tasks of main(), added in the same order: battery (triggers the reading), accelerometer, history, the reading and
+ * advertising. The reading runs every READ_INTERVAL, then every SAMPLING_INTERVAL_PARKED_MS, every period for SIMULATED_S.
+ * Other tasks must run on reading wake ups, so CPU wakes up only for readings. Advertising at the fast interval runs on
+ * every reading wake up, at the slow interval on the first one after the interval.
+ */
+static void testMainTasks()
+{
+    static const uint32_t READING_PERIODS_MS[] = {READ_INTERVAL, cfg::SAMPLING_INTERVAL_PARKED_MS};
+    static const uint32_t ADV_PERIODS_MS[] = {cfg::ADV_INTERVAL_FAST_MS, cfg::ADV_INTERVAL_SLOW_MS};
+    for (uint8_t run = 0; run < 4; run++)
+    {
+        const uint32_t reading_period_ms = READING_PERIODS_MS[run / 2];
+        const uint32_t adv_period_ms = ADV_PERIODS_MS[run % 2];
+        APP_TIMER_DEF(timer_id);
+        Task_scheduler<5> scheduler(timer_id);
+        p_scheduler = &scheduler;
+        reset(100);
+        Task_log battery, acc, history, reading, adv;
+        startLog(battery, cfg::READ_VBAT_INTERVAL_MS, cfg::TASK_SLACK_MS);
+        battery.trigger_on_run = everyTime;
+        scheduler.add(taskHandler, &battery, cfg::READ_VBAT_INTERVAL_MS, cfg::TASK_SLACK_MS);
+        startLog(acc, cfg::SUPERVISE_ACC_INTERVAL_MS, cfg::TASK_SLACK_MS);
+        scheduler.add(taskHandler, &acc, cfg::SUPERVISE_ACC_INTERVAL_MS, cfg::TASK_SLACK_MS);
+        startLog(history, cfg::HISTORY_LOG_INTERVAL * 1000UL, cfg::TASK_SLACK_MS);
+        scheduler.add(taskHandler, &history, cfg::HISTORY_LOG_INTERVAL * 1000UL, cfg::TASK_SLACK_MS);
+        startLog(reading, reading_period_ms);
+        triggered_task = scheduler.add(taskHandler, &reading, reading_period_ms);
+        p_triggered_log = &reading;
+        startLog(adv, adv_period_ms, cfg::TASK_SLACK_MS);
+        scheduler.add(taskHandler, &adv, adv_period_ms, cfg::TASK_SLACK_MS);
+        scheduler.start();
+
+        runFor(SIMULATED_S);
+
+        CHECK_EQUAL(SIMULATED_S * 1000 / reading_period_ms, reading.runs);
+        CHECK_EQUAL(reading.runs, mock::timer_irqs);     // no wake up for other tasks
+        CHECK_EQUAL(reading.runs * reading_period_ms, reading.elapsed_ms_sum);
+        CHECK_EQUAL(0, reading.max_late_ms);
+        CHECK_EQUAL(SIMULATED_S * 1000 / cfg::READ_VBAT_INTERVAL_MS, battery.runs);
+        CHECK_EQUAL(SIMULATED_S * 1000 / cfg::SUPERVISE_ACC_INTERVAL_MS, acc.runs);
+        CHECK_EQUAL(SIMULATED_S / cfg::HISTORY_LOG_INTERVAL, history.runs);
+        CHECK_EQUAL(reading.runs / ((adv_period_ms + reading_period_ms - 1) / reading_period_ms), adv.runs);
+        printf("reading every %lu ms, advertising every %lu ms: %lu wake ups, %lu advertising runs, battery late %lu ms "
+               "at most\n", (unsigned long)reading_period_ms, (unsigned long)adv_period_ms, (unsigned long)mock::timer_irqs,
+               (unsigned long)adv.runs, (unsigned long)battery.max_late_ms);
+    }
+}
+
+
+
+// A new period counts from the last run.
+static void testSetPeriod()
+{
+    APP_TIMER_DEF(timer_id);
+    Task_scheduler<5> scheduler(timer_id);
+    p_scheduler = &scheduler;
+    reset(5);
+    const uint64_t start = mock::rtc_ticks;
+    Task_log log;
+    startLog(log, 1000);
+    const uint8_t task = scheduler.add(taskHandler, &log, 1000);
+    scheduler.start();
+    runFor(10);
+    CHECK_EQUAL(10, log.runs);
+
+    scheduler.setPeriod(task, 4000);
+    log.period_ms = 4000;
+    log.due = log.last_run + msToTicks(4000);
+    runFor(3);
+    CHECK_EQUAL(10, log.runs);
+    runFor(1);
+    CHECK_EQUAL(11, log.runs);
+    CHECK_EQUAL(start + 14 * TICKS_PER_SECOND, log.last_run);
+    CHECK_EQUAL(11, mock::timer_irqs);
+}
+
+
+
+// A triggered task runs on the next wake up, or in the current dispatch when triggered by an earlier task.
+static void testTrigger()
+{
+    APP_TIMER_DEF(timer_id);
+    Task_scheduler<5> scheduler(timer_id);
+    p_scheduler = &scheduler;
+    reset(5);
+    Task_log fast, slow;
+    startLog(fast, 1000);
+    fast.trigger_on_run = fifthTime;
+    scheduler.add(taskHandler, &fast, 1000);
+    startLog(slow, 60000);
+    triggered_task = scheduler.add(taskHandler, &slow, 60000);
+    p_triggered_log = &slow;
+    scheduler.start();
+    runFor(10);
+    CHECK_EQUAL(1, slow.runs);
+    CHECK_EQUAL(5000, slow.elapsed_ms_sum);
+    CHECK_EQUAL(fast.runs, mock::timer_irqs);     // in the same wake up as the fifth fast run
+    CHECK_EQUAL(5, slow.last_run_irq);
+
+    slow.due = mock::rtc_ticks;
+    scheduler.trigger(triggered_task);     // from main(), wakes up as soon as app_timer can
+    const uint32_t irqs = mock::timer_irqs;
+    runFor(0);
+    CHECK_EQUAL(1, slow.runs);
+    mock::runTimers(mock::rtc_ticks + APP_TIMER_MIN_TIMEOUT_TICKS);
+    app_sched_execute();
+    CHECK_EQUAL(2, slow.runs);
+    CHECK_EQUAL(irqs + 1, mock::timer_irqs);
+}
+
+
+
+// A period longer than the longest sleep (half the 24 bit counter) takes extra wake ups, time keeps counting right.
+static void testLongPeriod()
+{
+    APP_TIMER_DEF(timer_id);
+    Task_scheduler<5> scheduler(timer_id);
+    p_scheduler = &scheduler;
+    reset(100);
+    Task_log log;
+    startLog(log, 1500 * 1000);
+    scheduler.add(taskHandler, &log, 1500 * 1000);
+    scheduler.start();
+    runFor(2 * 1500);
+    CHECK_EQUAL(2, log.runs);
+    CHECK_EQUAL(2 * 1500 * 1000, log.elapsed_ms_sum);
+    CHECK(mock::timer_irqs > log.runs);
+}
+
+
+
+int main()
+{
+    testMainTasks();
+    testSetPeriod();
+    testTrigger();
+    testLongPeriod();
+    return testResult("test_task_scheduler");
+}
@@ -0,0 +1,25 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+
+
+// Minimal checks for host tests. A test program returns testResult() from main(), so make fails on the first failing test.
+static int test_failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { test_failures++; printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); } } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { const long long e_ = (long long)(expected), a_ = (long long)(actual); \
+         if (e_ != a_) { test_failures++; printf("%s:%d: CHECK_EQUAL failed: %s = %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); } } while (0)
+
+
+// Prints the result of a test program. Returns: exit code for main()
+static inline int testResult(const char *p_name)
+{
+    printf("%s: %s\n", p_name, test_failures == 0 ? "OK" : "FAILED");
+    return test_failures == 0 ? 0 : 1;
+}
+
+#endif